@@ -113,6 +113,17 @@ check_sector (struct block *block, block_sector_t sector)
     }
 }
 
+/* Verifies that the CNT sectors starting at SECTOR are all
+   within BLOCK.  If not, panics the kernel. */
+static void
+check_range (struct block *block, block_sector_t sector, block_sector_t cnt)
+{
+  check_sector (block, sector);
+  if (cnt > block->size - sector)
+    PANIC ("Access past end of device %s (sector=%"PRDSNu", cnt=%"PRDSNu", "
+           "size=%"PRDSNu")\n", block_name (block), sector, cnt, block->size);
+}
+
 /* Reads sector SECTOR from BLOCK into BUFFER, which must
    have room for BLOCK_SECTOR_SIZE bytes.
    Internally synchronizes accesses to block devices, so external
@@ -139,6 +150,146 @@ block_write (struct block *block, block_sector_t sector, const void *buffer)
   block->write_cnt++;
 }
 
+/* Has BLOCK's driver read CNT sectors starting at SECTOR into
+   BUFFER, one at a time if it cannot do them all at once. */
+static void
+read_sectors (struct block *block, block_sector_t sector,
+              block_sector_t cnt, void *buffer)
+{
+  if (block->ops->read_multiple != NULL)
+    block->ops->read_multiple (block->aux, sector, cnt, buffer);
+  else
+    {
+      uint8_t *p = buffer;
+      block_sector_t i;
+
+      for (i = 0; i < cnt; i++)
+        block->ops->read (block->aux, sector + i,
+                          p + i * BLOCK_SECTOR_SIZE);
+    }
+}
+
+/* Has BLOCK's driver write CNT sectors starting at SECTOR from
+   BUFFER, one at a time if it cannot do them all at once. */
+static void
+write_sectors (struct block *block, block_sector_t sector,
+               block_sector_t cnt, const void *buffer)
+{
+  if (block->ops->write_multiple != NULL)
+    block->ops->write_multiple (block->aux, sector, cnt, buffer);
+  else
+    {
+      const uint8_t *p = buffer;
+      block_sector_t i;
+
+      for (i = 0; i < cnt; i++)
+        block->ops->write (block->aux, sector + i,
+                           p + i * BLOCK_SECTOR_SIZE);
+    }
+}
+
+/* Reads the CNT consecutive sectors starting at SECTOR from
+   BLOCK into BUFFER, which must have room for
+   CNT * BLOCK_SECTOR_SIZE bytes.  Drivers that can move several
+   sectors with a single command do so, which is much cheaper
+   than CNT calls to block_read().
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_multiple (struct block *block, block_sector_t sector,
+                     block_sector_t cnt, void *buffer)
+{
+  if (cnt == 0)
+    return;
+  check_range (block, sector, cnt);
+  read_sectors (block, sector, cnt, buffer);
+  block->read_cnt += cnt;
+}
+
+/* Writes the CNT consecutive sectors starting at SECTOR to
+   BLOCK from BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE
+   bytes.  Returns after the block device has acknowledged
+   receiving all of the data.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_multiple (struct block *block, block_sector_t sector,
+                      block_sector_t cnt, const void *buffer)
+{
+  if (cnt == 0)
+    return;
+  check_range (block, sector, cnt);
+  ASSERT (block->type != BLOCK_FOREIGN);
+  write_sectors (block, sector, cnt, buffer);
+  block->write_cnt += cnt;
+}
+
+/* Initializes R to transfer the CNT sectors starting at SECTOR
+   to BUFFER, or from it if WRITE is true, with no completion
+   callback. */
+void
+block_request_init (struct block_request *r, block_sector_t sector,
+                    block_sector_t cnt, void *buffer, bool write)
+{
+  ASSERT (cnt > 0);
+
+  r->sector = sector;
+  r->cnt = cnt;
+  r->buffer = buffer;
+  r->write = write;
+  r->complete = NULL;
+  r->aux = NULL;
+  sema_init (&r->done, 0);
+}
+
+/* Starts request R on BLOCK.  Drivers with a request queue
+   return at once, leaving R to complete in the background, and
+   may reorder or merge it with other queued requests; use
+   block_wait() or R's completion callback to learn when it is
+   done.  Other drivers finish R before returning. */
+void
+block_submit (struct block *block, struct block_request *r)
+{
+  check_range (block, r->sector, r->cnt);
+  if (r->write)
+    {
+      ASSERT (block->type != BLOCK_FOREIGN);
+      block->write_cnt += r->cnt;
+    }
+  else
+    block->read_cnt += r->cnt;
+
+  if (block->ops->submit != NULL)
+    block->ops->submit (block->aux, r);
+  else
+    {
+      if (r->write)
+        write_sectors (block, r->sector, r->cnt, r->buffer);
+      else
+        read_sectors (block, r->sector, r->cnt, r->buffer);
+      block_request_done (r);
+    }
+}
+
+/* Waits for request R, previously passed to block_submit(), to
+   complete. */
+void
+block_wait (struct block_request *r)
+{
+  sema_down (&r->done);
+}
+
+/* Called by a driver when request R is done.  R must no longer
+   be on any driver list, because the submitter may reuse it as
+   soon as this function is called. */
+void
+block_request_done (struct block_request *r)
+{
+  if (r->complete != NULL)
+    r->complete (r, r->aux);
+  sema_up (&r->done);
+}
+
 /* Returns the number of sectors in BLOCK. */
 block_sector_t
 block_size (struct block *block)
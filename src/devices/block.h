@@ -2,7 +2,10 @@
 #define DEVICES_BLOCK_H
 
 #include <stddef.h>
+#include <stdbool.h>
 #include <inttypes.h>
+#include <list.h>
+#include "threads/synch.h"
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -53,9 +56,41 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multiple (struct block *, block_sector_t, block_sector_t cnt,
+                          void *);
+void block_write_multiple (struct block *, block_sector_t, block_sector_t cnt,
+                           const void *);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
+/* An asynchronous request to transfer CNT consecutive sectors.
+   Initialize with block_request_init(), optionally set COMPLETE
+   and AUX, then pass to block_submit().  The request must stay
+   in place until it completes. */
+struct block_request
+  {
+    block_sector_t sector;      /* First sector.  Drivers that stack
+                                   on another device may rewrite it. */
+    block_sector_t cnt;         /* Number of sectors. */
+    void *buffer;               /* CNT * BLOCK_SECTOR_SIZE bytes. */
+    bool write;                 /* Write BUFFER, or read into it? */
+
+    /* If nonnull, called once the transfer is done, possibly from
+       a driver thread or an interrupt handler, so it must not
+       sleep. */
+    void (*complete) (struct block_request *, void *aux);
+    void *aux;                  /* Passed to COMPLETE. */
+
+    /* Owned by the block layer and drivers. */
+    struct list_elem elem;      /* Element in a driver's queue. */
+    struct semaphore done;      /* Up'd when the request completes. */
+  };
+
+void block_request_init (struct block_request *, block_sector_t,
+                         block_sector_t cnt, void *buffer, bool write);
+void block_submit (struct block *, struct block_request *);
+void block_wait (struct block_request *);
+
 /* Statistics. */
 void block_print_stats (void);
 
@@ -65,10 +100,25 @@ struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+
+    /* Optional.  Transfer CNT consecutive sectors at once.  If
+       null, the block layer falls back to READ or WRITE for each
+       sector in turn. */
+    void (*read_multiple) (void *aux, block_sector_t, block_sector_t cnt,
+                           void *buffer);
+    void (*write_multiple) (void *aux, block_sector_t, block_sector_t cnt,
+                            const void *buffer);
+
+    /* Optional.  Queues a request and returns without waiting for
+       it.  The driver must call block_request_done() once the
+       transfer finishes.  If null, block_submit() does the transfer
+       synchronously. */
+    void (*submit) (void *aux, struct block_request *);
   };
 
 struct block *block_register (const char *name, enum block_type,
                               const char *extra_info, block_sector_t size,
                               const struct block_operations *, void *aux);
+void block_request_done (struct block_request *);
 
 #endif /* devices/block.h */
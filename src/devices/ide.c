@@ -3,15 +3,47 @@
 #include <debug.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 #include "devices/block.h"
 #include "devices/partition.h"
+#include "devices/pci.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].
+
+   If the PCI bus has an IDE controller capable of bus master
+   DMA, such as the PIIX that QEMU emulates, sectors are
+   transferred by DMA through a bounce buffer, so that the CPU is
+   free while the disk works.  Otherwise, and for IDENTIFY
+   DEVICE, they are transferred by PIO.
+
+   Requests are queued per disk and carried out by one thread per
+   channel, which serves them in C-LOOK order: ascending sector
+   order from where the head last stopped, wrapping around to the
+   lowest queued sector.  Queued requests in the same direction
+   that continue one another are merged into a single transfer,
+   so that, say, readers in several processes walking through
+   neighbouring sectors share commands rather than seeking back
+   and forth.
+
+   Runs of consecutive sectors are moved with as few commands as
+   possible: up to MAX_SECTORS per command by PIO, or as many as
+   fit in the bounce buffer by DMA. */
+
+/* Most sectors a single command can transfer. */
+#define MAX_SECTORS 256
+
+/* Pages in each channel's DMA bounce buffer, and the sectors
+   they hold. */
+#define DMA_PAGES 8
+#define DMA_SECTORS (DMA_PAGES * PGSIZE / BLOCK_SECTOR_SIZE)
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
@@ -30,10 +62,24 @@
 #define reg_ctl(CHANNEL) ((CHANNEL)->reg_base + 0x206)  /* Control (w/o). */
 #define reg_alt_status(CHANNEL) reg_ctl (CHANNEL)       /* Alt Status (r/o). */
 
+/* Bus master IDE port addresses. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table. */
+
+/* Bus master Command Register bits. */
+#define BMC_START 0x01          /* Start transfer. */
+#define BMC_READ 0x08           /* Transfer from disk to memory. */
+
+/* Bus master Status Register bits. */
+#define BMS_ERROR 0x02          /* Transfer failed (write 1 to clear). */
+#define BMS_IRQ 0x04            /* Device interrupted (write 1 to clear). */
+
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +95,19 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* A physical region descriptor, which tells the bus master where
+   in memory one piece of a DMA transfer goes.  A PRD table is an
+   array of these, the last one marked PRD_EOT. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address. */
+    uint16_t size;              /* Byte count, 0 meaning 64 kB. */
+    uint16_t flags;             /* PRD_EOT or 0. */
+  };
+#define PRD_EOT 0x8000          /* End of table. */
 
 /* An ATA device. */
 struct ata_disk
@@ -57,6 +116,10 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+
+    /* Protected by the channel's lock. */
+    struct list queue;          /* Pending block_requests, by sector. */
+    block_sector_t head;        /* Sector after the last one served. */
   };
 
 /* An ATA channel (aka controller).
@@ -67,11 +130,16 @@ struct channel
     uint16_t reg_base;          /* Base I/O port. */
     uint8_t irq;                /* Interrupt in use. */
 
-    struct lock lock;           /* Must acquire to access the controller. */
+    struct lock lock;           /* Protects the disks' queues. */
+    struct condition queue_ready;   /* Signaled when a queue grows. */
     bool expecting_interrupt;   /* True if an interrupt is expected, false if
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    uint16_t bm_base;           /* Bus master base I/O port, 0 if PIO only. */
+    struct prd *prdt;           /* PRD table, in its own page. */
+    uint8_t *dma_buf;           /* DMA_PAGES bounce buffer for DMA. */
+
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
 
@@ -81,14 +149,30 @@ static struct channel channels[CHANNEL_CNT];
 
 static struct block_operations ide_operations;
 
+static void init_dma (struct channel *, uint16_t bm_base);
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void select_sector (struct ata_disk *, block_sector_t,
+                           block_sector_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
+static thread_func channel_thread NO_RETURN;
+
+/* Position within a batch of merged requests. */
+struct batch_pos
+  {
+    struct list_elem *elem;     /* Current request. */
+    block_sector_t ofs;         /* Sector offset within it. */
+  };
+
+static uint8_t *next_sector (struct batch_pos *);
+static bool pio_transfer (struct ata_disk *, block_sector_t,
+                          block_sector_t cnt, struct batch_pos *, bool read);
+static bool dma_transfer (struct ata_disk *, block_sector_t,
+                          block_sector_t cnt, bool read);
 
 static void wait_until_idle (const struct ata_disk *);
 static bool wait_while_busy (const struct ata_disk *);
@@ -101,8 +185,19 @@ static void interrupt_handler (struct intr_frame *);
 void
 ide_init (void) 
 {
+  struct pci_dev ide_pci;
+  uint16_t bm_base = 0;
   size_t chan_no;
 
+  /* Look for a bus master IDE controller.  Its fifth base address
+     register holds the bus master ports, eight per channel. */
+  if (pci_find_class (PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, &ide_pci))
+    {
+      bm_base = pci_io_base (&ide_pci, 4);
+      if (bm_base != 0)
+        pci_enable_bus_master (&ide_pci);
+    }
+
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
     {
       struct channel *c = &channels[chan_no];
@@ -124,8 +219,10 @@ ide_init (void)
           NOT_REACHED ();
         }
       lock_init (&c->lock);
+      cond_init (&c->queue_ready);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      init_dma (c, bm_base != 0 ? bm_base + chan_no * 8 : 0);
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,6 +233,8 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          list_init (&d->queue);
+          d->head = 0;
         }
 
       /* Register interrupt handler. */
@@ -144,6 +243,13 @@ ide_init (void)
       /* Reset hardware. */
       reset_channel (c);
 
+      /* Start serving requests.  The thread leaves the hardware
+         alone while the queues are empty, which they are except
+         while partition_scan() reads a newly identified disk.
+         It runs at PRI_MAX, since every thread waiting on the
+         disk depends on it and it sleeps between transfers. */
+      thread_create (c->name, PRI_MAX, channel_thread, c);
+
       /* Distinguish ATA hard disks from other devices. */
       if (check_device_type (&c->devices[0]))
         check_device_type (&c->devices[1]);
@@ -155,6 +261,33 @@ ide_init (void)
     }
 }
 
+/* Sets up channel C for bus master DMA through the ports at
+   BM_BASE, or for PIO only if BM_BASE is 0 or memory for the PRD
+   table and bounce buffer is short. */
+static void
+init_dma (struct channel *c, uint16_t bm_base)
+{
+  c->bm_base = 0;
+  c->prdt = NULL;
+  c->dma_buf = NULL;
+  if (bm_base == 0)
+    return;
+
+  c->prdt = palloc_get_page (0);
+  c->dma_buf = palloc_get_multiple (0, DMA_PAGES);
+  if (c->prdt == NULL || c->dma_buf == NULL)
+    {
+      palloc_free_page (c->prdt);
+      palloc_free_multiple (c->dma_buf, DMA_PAGES);
+      c->prdt = NULL;
+      c->dma_buf = NULL;
+      return;
+    }
+  c->bm_base = bm_base;
+  outb (reg_bm_command (c), 0);
+  outb (reg_bm_status (c), BMS_ERROR | BMS_IRQ);
+}
+
 /* Disk detection and identification. */
 
 static char *descramble_ata_string (char *, int size);
@@ -337,63 +470,250 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
-   Internally synchronizes accesses to disks, so external
-   per-disk locking is unneeded. */
+/* Returns true if block_request A precedes B in sector order. */
+static bool
+request_less (const struct list_elem *a_, const struct list_elem *b_,
+              void *aux UNUSED)
+{
+  const struct block_request *a = list_entry (a_, struct block_request, elem);
+  const struct block_request *b = list_entry (b_, struct block_request, elem);
+  return a->sector < b->sector;
+}
+
+/* Queues request R for disk D. */
 static void
-ide_read (void *d_, block_sector_t sec_no, void *buffer)
+ide_submit (void *d_, struct block_request *r)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
+  list_insert_ordered (&d->queue, &r->elem, request_less, NULL);
+  cond_signal (&c->queue_ready, &c->lock);
   lock_release (&c->lock);
 }
 
+/* Transfers CNT sectors starting at SEC_NO between disk D and
+   BUFFER, from the disk unless WRITE is true, and waits for the
+   transfer to finish. */
+static void
+transfer (struct ata_disk *d, block_sector_t sec_no, block_sector_t cnt,
+          void *buffer, bool write)
+{
+  struct block_request r;
+
+  block_request_init (&r, sec_no, cnt, buffer, write);
+  ide_submit (d, &r);
+  block_wait (&r);
+}
+
+/* Reads sector SEC_NO from disk D into BUFFER, which must have
+   room for BLOCK_SECTOR_SIZE bytes.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_read (void *d, block_sector_t sec_no, void *buffer)
+{
+  transfer (d, sec_no, 1, buffer, false);
+}
+
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
    BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
    acknowledged receiving the data.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+ide_write (void *d, block_sector_t sec_no, const void *buffer)
 {
-  struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
-  lock_release (&c->lock);
+  transfer (d, sec_no, 1, (void *) buffer, true);
+}
+
+/* Reads CNT sectors starting at SEC_NO from disk D into BUFFER,
+   which must have room for CNT * BLOCK_SECTOR_SIZE bytes. */
+static void
+ide_read_multiple (void *d, block_sector_t sec_no, block_sector_t cnt,
+                   void *buffer)
+{
+  transfer (d, sec_no, cnt, buffer, false);
+}
+
+/* Writes CNT sectors starting at SEC_NO to disk D from BUFFER,
+   which must contain CNT * BLOCK_SECTOR_SIZE bytes.  Returns
+   after the disk has acknowledged receiving the data. */
+static void
+ide_write_multiple (void *d, block_sector_t sec_no, block_sector_t cnt,
+                    const void *buffer)
+{
+  transfer (d, sec_no, cnt, (void *) buffer, true);
 }
 
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multiple,
+    ide_write_multiple,
+    ide_submit
   };
-
+
+/* Request scheduling. */
+
+/* Moves the next requests to serve from disk D's queue to BATCH,
+   and returns their total number of sectors.  The first request
+   is the lowest-numbered one at or past D's head, or failing
+   that the lowest-numbered one overall.  Following requests in
+   the same direction that start where the batch ends join it,
+   up to LIMIT sectors.  The caller must hold the channel's lock
+   and D's queue must not be empty. */
+static block_sector_t
+take_batch (struct ata_disk *d, struct list *batch, block_sector_t limit)
+{
+  struct block_request *first, *r;
+  struct list_elem *e;
+  block_sector_t cnt;
+
+  ASSERT (lock_held_by_current_thread (&d->channel->lock));
+  ASSERT (!list_empty (&d->queue));
+
+  for (e = list_begin (&d->queue); e != list_end (&d->queue);
+       e = list_next (e))
+    if (list_entry (e, struct block_request, elem)->sector >= d->head)
+      break;
+  if (e == list_end (&d->queue))
+    e = list_begin (&d->queue);
+
+  first = list_entry (e, struct block_request, elem);
+  cnt = first->cnt;
+  e = list_remove (e);
+  list_push_back (batch, &first->elem);
+  while (e != list_end (&d->queue))
+    {
+      r = list_entry (e, struct block_request, elem);
+      if (r->sector != first->sector + cnt || r->write != first->write
+          || cnt + r->cnt > limit)
+        break;
+      cnt += r->cnt;
+      e = list_remove (e);
+      list_push_back (batch, &r->elem);
+    }
+  d->head = first->sector + cnt;
+  return cnt;
+}
+
+/* Returns the buffer for the sector at POS and advances POS to
+   the following sector. */
+static uint8_t *
+next_sector (struct batch_pos *pos)
+{
+  struct block_request *r = list_entry (pos->elem, struct block_request,
+                                        elem);
+  uint8_t *p = (uint8_t *) r->buffer + pos->ofs * BLOCK_SECTOR_SIZE;
+
+  if (++pos->ofs == r->cnt)
+    {
+      pos->elem = list_next (pos->elem);
+      pos->ofs = 0;
+    }
+  return p;
+}
+
+/* Carries out the CNT sectors of requests in BATCH, which are
+   consecutive on disk D starting at SEC_NO and all in the same
+   direction, then completes them.  Panics if the disk reports an
+   error. */
+static void
+do_batch (struct ata_disk *d, struct list *batch, block_sector_t sec_no,
+          block_sector_t cnt)
+{
+  struct channel *c = d->channel;
+  bool read = !list_entry (list_front (batch), struct block_request,
+                           elem)->write;
+  struct batch_pos pos;
+
+  pos.elem = list_begin (batch);
+  pos.ofs = 0;
+  while (cnt > 0)
+    {
+      block_sector_t chunk = c->bm_base != 0 ? DMA_SECTORS : MAX_SECTORS;
+      block_sector_t i;
+      bool ok;
+
+      if (chunk > cnt)
+        chunk = cnt;
+      if (c->bm_base != 0)
+        {
+          if (!read)
+            for (i = 0; i < chunk; i++)
+              memcpy (c->dma_buf + i * BLOCK_SECTOR_SIZE, next_sector (&pos),
+                      BLOCK_SECTOR_SIZE);
+          ok = dma_transfer (d, sec_no, chunk, read);
+          if (ok && read)
+            for (i = 0; i < chunk; i++)
+              memcpy (next_sector (&pos), c->dma_buf + i * BLOCK_SECTOR_SIZE,
+                      BLOCK_SECTOR_SIZE);
+        }
+      else
+        ok = pio_transfer (d, sec_no, chunk, &pos, read);
+      if (!ok)
+        PANIC ("%s: disk %s failed, sector=%"PRDSNu,
+               d->name, read ? "read" : "write", sec_no);
+
+      sec_no += chunk;
+      cnt -= chunk;
+    }
+
+  while (!list_empty (batch))
+    block_request_done (list_entry (list_pop_front (batch),
+                                    struct block_request, elem));
+}
+
+/* Serves the request queues of the disks on channel C_, one
+   batch at a time.  Stays with one disk until its queue drains,
+   then moves to the other. */
+static void
+channel_thread (void *c_)
+{
+  struct channel *c = c_;
+  int dev_no = 0;
+
+  for (;;)
+    {
+      struct ata_disk *d;
+      struct list batch;
+      block_sector_t sec_no, cnt;
+
+      lock_acquire (&c->lock);
+      while (list_empty (&c->devices[0].queue)
+             && list_empty (&c->devices[1].queue))
+        cond_wait (&c->queue_ready, &c->lock);
+      if (list_empty (&c->devices[dev_no].queue))
+        dev_no = !dev_no;
+      d = &c->devices[dev_no];
+      list_init (&batch);
+      cnt = take_batch (d, &batch, c->bm_base != 0 ? DMA_SECTORS : MAX_SECTORS);
+      sec_no = d->head - cnt;
+      lock_release (&c->lock);
+
+      do_batch (d, &batch, sec_no, cnt);
+    }
+}
+
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and CNT to the disk's sector selection
+   registers.  (We use 28-bit LBA mode, which covers every disk
+   that identify_ata_device() accepts.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sector (struct ata_disk *d, block_sector_t sec_no, block_sector_t cnt)
 {
   struct channel *c = d->channel;
 
-  ASSERT (sec_no < (1UL << 28));
-  
+  ASSERT (sec_no + cnt <= (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= MAX_SECTORS);
+
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+
+  /* A count of 0 asks for MAX_SECTORS. */
+  outb (reg_nsect (c), cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -402,7 +722,8 @@ select_sector (struct ata_disk *d, block_sector_t sec_no)
 }
 
 /* Writes COMMAND to channel C and prepares for receiving a
-   completion interrupt. */
+   completion interrupt.  Also used for DMA commands, which
+   complete with an interrupt in the same way. */
 static void
 issue_pio_command (struct channel *c, uint8_t command) 
 {
@@ -430,6 +751,83 @@ output_sector (struct channel *c, const void *sector)
   outsw (reg_data (c), sector, BLOCK_SECTOR_SIZE / 2);
 }
 
+/* Transfers CNT sectors starting at SEC_NO between disk D and
+   the buffers at POS by PIO, from the disk if READ is true and to
+   it otherwise, advancing POS.  The disk interrupts once per
+   sector.  Returns true if successful, false if the disk
+   reported an error.  Only the channel's thread may call this. */
+static bool
+pio_transfer (struct ata_disk *d, block_sector_t sec_no, block_sector_t cnt,
+              struct batch_pos *pos, bool read)
+{
+  struct channel *c = d->channel;
+  block_sector_t i;
+
+  select_sector (d, sec_no, cnt);
+  issue_pio_command (c, read ? CMD_READ_SECTOR_RETRY : CMD_WRITE_SECTOR_RETRY);
+  for (i = 0; i < cnt; i++)
+    if (read)
+      {
+        sema_down (&c->completion_wait);
+        if (!wait_while_busy (d))
+          return false;
+        input_sector (c, next_sector (pos));
+      }
+    else
+      {
+        if (!wait_while_busy (d))
+          return false;
+        output_sector (c, next_sector (pos));
+        sema_down (&c->completion_wait);
+      }
+  return true;
+}
+
+/* Transfers CNT sectors starting at SEC_NO between disk D and
+   the start of its channel's bounce buffer by bus master DMA,
+   from the disk if READ is true and to it otherwise, sleeping
+   until the transfer completes.  Each page of the buffer gets
+   its own PRD, so that none crosses a 64 kB boundary.  Returns
+   true if successful, false if the controller or the disk
+   reported an error.  Only the channel's thread may call
+   this. */
+static bool
+dma_transfer (struct ata_disk *d, block_sector_t sec_no, block_sector_t cnt,
+              bool read)
+{
+  struct channel *c = d->channel;
+  uint8_t direction = read ? BMC_READ : 0;
+  size_t bytes = cnt * BLOCK_SECTOR_SIZE;
+  uint8_t bm_status;
+  size_t i;
+
+  ASSERT (cnt > 0 && cnt <= DMA_SECTORS);
+
+  for (i = 0; bytes > 0; i++)
+    {
+      size_t chunk = bytes < PGSIZE ? bytes : PGSIZE;
+      c->prdt[i].addr = vtop (c->dma_buf + i * PGSIZE);
+      c->prdt[i].size = chunk;
+      c->prdt[i].flags = 0;
+      bytes -= chunk;
+    }
+  c->prdt[i - 1].flags = PRD_EOT;
+  outl (reg_bm_prdt (c), vtop (c->prdt));
+  outb (reg_bm_command (c), direction);
+  outb (reg_bm_status (c), BMS_ERROR | BMS_IRQ);
+
+  select_sector (d, sec_no, cnt);
+  issue_pio_command (c, read ? CMD_READ_DMA : CMD_WRITE_DMA);
+  outb (reg_bm_command (c), direction | BMC_START);
+  sema_down (&c->completion_wait);
+
+  outb (reg_bm_command (c), direction);
+  bm_status = inb (reg_bm_status (c));
+  outb (reg_bm_status (c), BMS_ERROR | BMS_IRQ);
+  return ((bm_status & BMS_ERROR) == 0
+          && (inb (reg_alt_status (c)) & (STA_BSY | STA_DRQ | STA_ERR)) == 0);
+}
+
 /* Low-level ATA primitives. */
 
 /* Wait up to 10 seconds for the controller to become idle, that
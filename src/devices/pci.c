@@ -0,0 +1,180 @@
+#include "devices/pci.h"
+#include <debug.h>
+#include "threads/io.h"
+
+/* This code reads and writes PCI configuration space through
+   configuration mechanism #1, which every PC chipset that Pintos
+   runs on supports.  It does just enough for drivers to find
+   their device and its I/O ports; there is no general PCI bus
+   driver. */
+
+/* Configuration mechanism #1 I/O ports. */
+#define PCI_CONFIG_ADDR 0xcf8   /* Selects bus, device, function, register. */
+#define PCI_CONFIG_DATA 0xcfc   /* Reads or writes the selected register. */
+
+/* Configuration space registers. */
+#define PCI_REG_ID 0x00         /* Vendor ID 15:0, device ID 31:16. */
+#define PCI_REG_COMMAND 0x04    /* Command 15:0, status 31:16. */
+#define PCI_REG_CLASS 0x08      /* Revision 7:0, interface 15:8,
+                                   subclass 23:16, class 31:24. */
+#define PCI_REG_HEADER 0x0c     /* Header type in bits 23:16. */
+#define PCI_REG_BAR0 0x10       /* First of six base address registers. */
+#define PCI_REG_IRQ 0x3c        /* Interrupt line 7:0. */
+
+/* Command register bits. */
+#define PCI_CMD_IO 0x0001       /* Respond to I/O space accesses. */
+#define PCI_CMD_MASTER 0x0004   /* May act as a bus master. */
+
+/* Header type bit for a device with more than one function. */
+#define PCI_HEADER_MULTI 0x80
+
+/* Base address register bits. */
+#define PCI_BAR_IO 0x1          /* Set for an I/O space BAR. */
+
+/* Reads 32-bit configuration register REG of function DEV. */
+uint32_t
+pci_read_config (const struct pci_dev *dev, uint8_t reg)
+{
+  outl (PCI_CONFIG_ADDR, (0x80000000u | (dev->bus << 16) | (dev->slot << 11)
+                          | (dev->func << 8) | (reg & 0xfc)));
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to 32-bit configuration register REG of function
+   DEV. */
+void
+pci_write_config (const struct pci_dev *dev, uint8_t reg, uint32_t value)
+{
+  outl (PCI_CONFIG_ADDR, (0x80000000u | (dev->bus << 16) | (dev->slot << 11)
+                          | (dev->func << 8) | (reg & 0xfc)));
+  outl (PCI_CONFIG_DATA, value);
+}
+
+/* Functions are numbered bus-major from 0 to FUNC_CNT - 1 by
+   func_index(), so that scans can start in the middle. */
+#define FUNC_CNT (256 * 32 * 8)
+
+/* Returns the index of function DEV. */
+static unsigned
+func_index (const struct pci_dev *dev)
+{
+  return (dev->bus << 8) | (dev->slot << 3) | dev->func;
+}
+
+/* Returns true if function 0 of DEV's device says that it has
+   other functions. */
+static bool
+is_multifunction (const struct pci_dev *dev)
+{
+  return (pci_read_config (dev, PCI_REG_HEADER) >> 16) & PCI_HEADER_MULTI;
+}
+
+/* Searches functions from index START upward for the first one
+   whose configuration register REG, masked by MASK, equals
+   VALUE, and stores its location in *DEV.  Returns true if one
+   was found, false otherwise. */
+static bool
+find (unsigned start, uint8_t reg, uint32_t mask, uint32_t value,
+      struct pci_dev *dev)
+{
+  unsigned idx;
+
+  for (idx = start; idx < FUNC_CNT; idx++)
+    {
+      struct pci_dev d;
+
+      d.bus = idx >> 8;
+      d.slot = (idx >> 3) & 0x1f;
+      d.func = idx & 7;
+      if ((pci_read_config (&d, PCI_REG_ID) & 0xffff) == 0xffff)
+        {
+          /* No function 0 means no device at all. */
+          if (d.func == 0)
+            idx |= 7;
+          continue;
+        }
+      if ((pci_read_config (&d, reg) & mask) == value)
+        {
+          *dev = d;
+          return true;
+        }
+      if (d.func == 0 && !is_multifunction (&d))
+        idx |= 7;
+    }
+  return false;
+}
+
+/* Returns the index of the first function after DEV that may
+   exist.  Single-function devices may answer for every function
+   number, so those are skipped. */
+static unsigned
+next_index (const struct pci_dev *dev)
+{
+  if (dev->func == 0 && !is_multifunction (dev))
+    return func_index (dev) + 8;
+  return func_index (dev) + 1;
+}
+
+/* Finds the first function with the given CLASS and SUBCLASS and
+   stores its location in *DEV.  Returns true if successful,
+   false if there is none. */
+bool
+pci_find_class (uint8_t class, uint8_t subclass, struct pci_dev *dev)
+{
+  return find (0, PCI_REG_CLASS, 0xffff0000,
+               ((uint32_t) class << 24) | ((uint32_t) subclass << 16), dev);
+}
+
+/* Finds the first function with the given VENDOR and DEVICE IDs
+   and stores its location in *DEV.  Returns true if successful,
+   false if there is none. */
+bool
+pci_find_device (uint16_t vendor, uint16_t device, struct pci_dev *dev)
+{
+  return find (0, PCI_REG_ID, 0xffffffff,
+               ((uint32_t) device << 16) | vendor, dev);
+}
+
+/* Finds the next function after *DEV, which must have been
+   found by pci_find_device() or this function, with the given
+   VENDOR and DEVICE IDs, and stores its location in *DEV.
+   Returns true if successful, false if there are no more. */
+bool
+pci_find_next_device (uint16_t vendor, uint16_t device, struct pci_dev *dev)
+{
+  return find (next_index (dev), PCI_REG_ID, 0xffffffff,
+               ((uint32_t) device << 16) | vendor, dev);
+}
+
+/* Returns the first I/O port of base address register BAR of
+   function DEV, or 0 if BAR does not describe I/O ports. */
+uint16_t
+pci_io_base (const struct pci_dev *dev, int bar)
+{
+  uint32_t value;
+
+  ASSERT (bar >= 0 && bar < 6);
+
+  value = pci_read_config (dev, PCI_REG_BAR0 + bar * 4);
+  return value & PCI_BAR_IO ? value & 0xfffc : 0;
+}
+
+/* Returns the legacy interrupt line of function DEV. */
+uint8_t
+pci_irq (const struct pci_dev *dev)
+{
+  return pci_read_config (dev, PCI_REG_IRQ) & 0xff;
+}
+
+/* Allows function DEV to respond to I/O port accesses and to
+   initiate DMA as a bus master. */
+void
+pci_enable_bus_master (const struct pci_dev *dev)
+{
+  uint32_t cmd = pci_read_config (dev, PCI_REG_COMMAND);
+
+  /* Leave the status half alone, since writing 1s there clears
+     bits. */
+  cmd = (cmd & 0xffff) | PCI_CMD_IO | PCI_CMD_MASTER;
+  pci_write_config (dev, PCI_REG_COMMAND, cmd);
+}
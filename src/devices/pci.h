@@ -0,0 +1,31 @@
+#ifndef DEVICES_PCI_H
+#define DEVICES_PCI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Location of a PCI function. */
+struct pci_dev
+  {
+    uint8_t bus;                /* Bus number. */
+    uint8_t slot;               /* Device number on the bus. */
+    uint8_t func;               /* Function number within the device. */
+  };
+
+/* Class codes. */
+#define PCI_CLASS_STORAGE 0x01          /* Mass storage controller. */
+#define PCI_SUBCLASS_IDE 0x01           /* IDE controller. */
+
+bool pci_find_class (uint8_t class, uint8_t subclass, struct pci_dev *);
+bool pci_find_device (uint16_t vendor, uint16_t device, struct pci_dev *);
+bool pci_find_next_device (uint16_t vendor, uint16_t device,
+                           struct pci_dev *);
+
+uint32_t pci_read_config (const struct pci_dev *, uint8_t reg);
+void pci_write_config (const struct pci_dev *, uint8_t reg, uint32_t);
+
+uint16_t pci_io_base (const struct pci_dev *, int bar);
+uint8_t pci_irq (const struct pci_dev *);
+void pci_enable_bus_master (const struct pci_dev *);
+
+#endif /* devices/pci.h */
@@ -0,0 +1,131 @@
+#include "devices/ramdisk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "devices/partition.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* A block device held in kernel memory, named "rd".
+
+   Takes the disk out of file system and VM measurements, so that
+   their CPU cost shows, and makes I/O-heavy runs fast.  Give it
+   a role with -filesys=rd, -scratch=rd, or -swap=rd.  It may
+   start out as a copy of another block device, such as a scratch
+   partition or a whole disk.  Its contents are lost at power
+   off. */
+
+/* Sectors copied per request while loading. */
+#define LOAD_CHUNK 64
+
+static uint8_t *ram;                    /* Contents. */
+
+static struct block_operations ramdisk_operations;
+
+static void load (struct block *source, block_sector_t size);
+
+/* Creates the RAM disk, SIZE_KB kB in size, and fills it from
+   the block device named SOURCE_NAME if that is nonnull.  A
+   SIZE_KB of 0 sizes the RAM disk to match SOURCE_NAME.  Does
+   nothing if both are 0 or null.  Panics if the kernel pool
+   cannot hold the RAM disk. */
+void
+ramdisk_init (size_t size_kb, const char *source_name)
+{
+  struct block *source = NULL;
+  struct block *block;
+  block_sector_t size;
+  char extra_info[32];
+
+  if (source_name != NULL)
+    {
+      source = block_get_by_name (source_name);
+      if (source == NULL)
+        PANIC ("No such block device \"%s\"", source_name);
+    }
+
+  if (size_kb != 0)
+    size = size_kb * (1024 / BLOCK_SECTOR_SIZE);
+  else if (source != NULL)
+    size = block_size (source);
+  else
+    return;
+
+  ram = palloc_get_multiple (PAL_ZERO,
+                             DIV_ROUND_UP (size * BLOCK_SECTOR_SIZE, PGSIZE));
+  if (ram == NULL)
+    PANIC ("rd: not enough memory for %"PRDSNu" sectors", size);
+
+  if (source != NULL)
+    {
+      load (source, size);
+      snprintf (extra_info, sizeof extra_info, "from %s", source_name);
+    }
+  block = block_register ("rd", BLOCK_RAW, source != NULL ? extra_info : NULL,
+                          size, &ramdisk_operations, NULL);
+
+  /* A copy of a whole disk has that disk's partitions. */
+  if (source != NULL && block_type (source) == BLOCK_RAW)
+    partition_scan (block);
+}
+
+/* Copies the start of SOURCE into the first SIZE sectors of the
+   RAM disk, or as much of them as SOURCE holds. */
+static void
+load (struct block *source, block_sector_t size)
+{
+  block_sector_t sector;
+
+  if (size > block_size (source))
+    size = block_size (source);
+  for (sector = 0; sector < size; sector += LOAD_CHUNK)
+    {
+      block_sector_t cnt = size - sector;
+      if (cnt > LOAD_CHUNK)
+        cnt = LOAD_CHUNK;
+      block_read_multiple (source, sector, cnt,
+                           ram + sector * BLOCK_SECTOR_SIZE);
+    }
+}
+
+/* Reads CNT sectors starting at SECTOR into BUFFER. */
+static void
+ramdisk_read_multiple (void *aux UNUSED, block_sector_t sector,
+                       block_sector_t cnt, void *buffer)
+{
+  memcpy (buffer, ram + sector * BLOCK_SECTOR_SIZE, cnt * BLOCK_SECTOR_SIZE);
+}
+
+/* Writes CNT sectors starting at SECTOR from BUFFER. */
+static void
+ramdisk_write_multiple (void *aux UNUSED, block_sector_t sector,
+                        block_sector_t cnt, const void *buffer)
+{
+  memcpy (ram + sector * BLOCK_SECTOR_SIZE, buffer, cnt * BLOCK_SECTOR_SIZE);
+}
+
+/* Reads SECTOR into BUFFER. */
+static void
+ramdisk_read (void *aux, block_sector_t sector, void *buffer)
+{
+  ramdisk_read_multiple (aux, sector, 1, buffer);
+}
+
+/* Writes SECTOR from BUFFER. */
+static void
+ramdisk_write (void *aux, block_sector_t sector, const void *buffer)
+{
+  ramdisk_write_multiple (aux, sector, 1, buffer);
+}
+
+static struct block_operations ramdisk_operations =
+  {
+    ramdisk_read,
+    ramdisk_write,
+    ramdisk_read_multiple,
+    ramdisk_write_multiple,
+    NULL                        /* Finishes every request at once. */
+  };
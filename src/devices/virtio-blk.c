@@ -0,0 +1,403 @@
+#include "devices/virtio-blk.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <round.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "devices/block.h"
+#include "devices/partition.h"
+#include "devices/pci.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* The code in this file drives virtio block devices, as QEMU
+   provides with "-drive if=virtio", through the legacy PCI
+   interface of [Virtio 0.9.5].
+
+   Each device has a single virtqueue.  A request takes three
+   descriptors: a header saying what to do, the data buffer, and
+   a status byte for the device to fill in.  Descriptors are
+   handed out in fixed triples called slots, so up to a third of
+   the queue's size can be outstanding at once.  Completions are
+   taken off the used ring by the interrupt handler.
+
+   The data buffer of a request is described by a single
+   descriptor, so it must be physically contiguous.  That holds
+   for any kernel virtual address, because kernel memory is
+   mapped linearly. */
+
+/* PCI IDs of a legacy virtio block device. */
+#define VIRTIO_VENDOR 0x1af4
+#define VIRTIO_BLK_DEVICE 0x1001
+
+/* Legacy virtio I/O port offsets. */
+#define VIRTIO_DEVICE_FEATURES 0x00     /* Device features (r/o, 32 bits). */
+#define VIRTIO_GUEST_FEATURES 0x04      /* Driver features (32 bits). */
+#define VIRTIO_QUEUE_PFN 0x08           /* Queue page number (32 bits). */
+#define VIRTIO_QUEUE_SIZE 0x0c          /* Queue size (r/o, 16 bits). */
+#define VIRTIO_QUEUE_SELECT 0x0e        /* Queue selector (16 bits). */
+#define VIRTIO_QUEUE_NOTIFY 0x10        /* Queue notifier (16 bits). */
+#define VIRTIO_STATUS 0x12              /* Device status (8 bits). */
+#define VIRTIO_ISR 0x13                 /* ISR status (r/o, 8 bits). */
+#define VIRTIO_BLK_CAPACITY 0x14        /* Sectors (r/o, 64 bits). */
+
+/* Device status bits. */
+#define STATUS_ACKNOWLEDGE 0x01         /* Driver noticed the device. */
+#define STATUS_DRIVER 0x02              /* Driver can drive it. */
+#define STATUS_DRIVER_OK 0x04           /* Driver is ready. */
+
+/* ISR status bits. */
+#define ISR_QUEUE 0x01                  /* A queue has used buffers. */
+
+/* Virtqueue memory is laid out in this alignment. */
+#define VRING_ALIGN PGSIZE
+
+/* A virtqueue descriptor. */
+struct vring_desc
+  {
+    uint64_t addr;              /* Physical address. */
+    uint32_t len;               /* Length in bytes. */
+    uint16_t flags;             /* VRING_DESC_F_*. */
+    uint16_t next;              /* Next descriptor, if VRING_DESC_F_NEXT. */
+  };
+#define VRING_DESC_F_NEXT 1     /* Chain continues at NEXT. */
+#define VRING_DESC_F_WRITE 2    /* Device writes, rather than reads. */
+
+/* Ring of descriptor chains offered to the device. */
+struct vring_avail
+  {
+    uint16_t flags;
+    uint16_t idx;               /* Where the next entry goes, mod size. */
+    uint16_t ring[];            /* Heads of descriptor chains. */
+  };
+
+/* Ring of descriptor chains the device has finished with. */
+struct vring_used_elem
+  {
+    uint32_t id;                /* Head of descriptor chain. */
+    uint32_t len;               /* Bytes written by the device. */
+  };
+
+struct vring_used
+  {
+    uint16_t flags;
+    uint16_t idx;               /* Where the next entry goes, mod size. */
+    struct vring_used_elem ring[];
+  };
+
+/* Request types. */
+#define VIRTIO_BLK_T_IN 0       /* Read. */
+#define VIRTIO_BLK_T_OUT 1      /* Write. */
+
+/* Request status. */
+#define VIRTIO_BLK_S_OK 0
+
+/* Descriptors per request. */
+#define SLOT_DESCS 3
+
+/* An outstanding request and the header and status that its
+   descriptors point to. */
+struct slot
+  {
+    struct                      /* Request header, read by the device. */
+      {
+        uint32_t type;          /* VIRTIO_BLK_T_*. */
+        uint32_t reserved;
+        uint64_t sector;        /* First sector. */
+      }
+    hdr;
+    uint8_t status;             /* Written by the device. */
+    struct block_request *request;      /* Request being served. */
+  };
+
+/* A virtio block device. */
+struct virtio_blk
+  {
+    char name[8];               /* Name, e.g. "vda". */
+    uint16_t io_base;           /* Base I/O port. */
+    uint8_t irq;                /* Interrupt vector in use. */
+
+    /* The virtqueue. */
+    uint16_t queue_size;        /* Number of descriptors. */
+    struct vring_desc *desc;    /* Descriptor table. */
+    struct vring_avail *avail;  /* Available ring. */
+    volatile struct vring_used *used;   /* Used ring. */
+    uint16_t last_used;         /* Used ring index we have handled. */
+
+    /* Slots.  Protected by turning off interrupts. */
+    struct slot *slots;         /* Array of slots, in one page. */
+    size_t slot_cnt;            /* Number of slots. */
+    struct bitmap *busy_slots;  /* Slots in use. */
+    struct semaphore free_slots;        /* Number of free slots. */
+  };
+
+/* Virtio block devices, up to as many as there are IDE disks. */
+#define VIRTIO_BLK_MAX 4
+static struct virtio_blk devices[VIRTIO_BLK_MAX];
+static size_t device_cnt;
+
+static struct block_operations virtio_blk_operations;
+
+static bool init_device (struct virtio_blk *, const struct pci_dev *);
+static bool init_queue (struct virtio_blk *);
+static void interrupt_handler (struct intr_frame *);
+
+/* Finds virtio block devices on the PCI bus and registers each
+   one with the block device layer. */
+void
+virtio_blk_init (void)
+{
+  struct pci_dev pci;
+  bool found;
+
+  for (found = pci_find_device (VIRTIO_VENDOR, VIRTIO_BLK_DEVICE, &pci);
+       found && device_cnt < VIRTIO_BLK_MAX;
+       found = pci_find_next_device (VIRTIO_VENDOR, VIRTIO_BLK_DEVICE, &pci))
+    {
+      struct virtio_blk *d = &devices[device_cnt];
+      uint64_t capacity;
+      struct block *block;
+
+      snprintf (d->name, sizeof d->name, "vd%c", 'a' + (int) device_cnt);
+      if (!init_device (d, &pci))
+        {
+          printf ("%s: initialization failed\n", d->name);
+          continue;
+        }
+      device_cnt++;
+
+      capacity = (inl (d->io_base + VIRTIO_BLK_CAPACITY)
+                  | (uint64_t) inl (d->io_base + VIRTIO_BLK_CAPACITY + 4) << 32);
+      if (capacity > UINT32_MAX)
+        capacity = UINT32_MAX;
+      block = block_register (d->name, BLOCK_RAW, "virtio", capacity,
+                              &virtio_blk_operations, d);
+      partition_scan (block);
+    }
+}
+
+/* Resets the device at PCI and makes D drive it.  Returns true
+   if successful, false if the device or memory is not up to
+   it. */
+static bool
+init_device (struct virtio_blk *d, const struct pci_dev *pci)
+{
+  size_t i;
+
+  d->io_base = pci_io_base (pci, 0);
+  if (d->io_base == 0 || pci_irq (pci) >= 16)
+    return false;
+  pci_enable_bus_master (pci);
+
+  /* Reset, then introduce ourselves.  We need none of the
+     optional features. */
+  outb (d->io_base + VIRTIO_STATUS, 0);
+  outb (d->io_base + VIRTIO_STATUS, STATUS_ACKNOWLEDGE);
+  outb (d->io_base + VIRTIO_STATUS, STATUS_ACKNOWLEDGE | STATUS_DRIVER);
+  outl (d->io_base + VIRTIO_GUEST_FEATURES, 0);
+
+  if (!init_queue (d))
+    return false;
+
+  /* Share the handler among devices on the same line. */
+  d->irq = pci_irq (pci) + 0x20;
+  for (i = 0; i < device_cnt; i++)
+    if (devices[i].irq == d->irq)
+      break;
+  if (i == device_cnt)
+    intr_register_ext (d->irq, interrupt_handler, "virtio-blk");
+
+  outb (d->io_base + VIRTIO_STATUS,
+        STATUS_ACKNOWLEDGE | STATUS_DRIVER | STATUS_DRIVER_OK);
+  return true;
+}
+
+/* Sets up queue 0 of device D, with its slots.  Returns true if
+   successful, false on failure. */
+static bool
+init_queue (struct virtio_blk *d)
+{
+  size_t n, avail_end, used_ofs, used_end, page_cnt;
+  uint8_t *vring;
+
+  outw (d->io_base + VIRTIO_QUEUE_SELECT, 0);
+  n = inw (d->io_base + VIRTIO_QUEUE_SIZE);
+  if (n < SLOT_DESCS)
+    return false;
+
+  /* The descriptor table and available ring come first, then the
+     used ring on the next VRING_ALIGN boundary. */
+  avail_end = n * sizeof (struct vring_desc)
+              + sizeof (struct vring_avail) + (n + 1) * sizeof (uint16_t);
+  used_ofs = ROUND_UP (avail_end, VRING_ALIGN);
+  used_end = used_ofs + sizeof (struct vring_used)
+             + n * sizeof (struct vring_used_elem) + sizeof (uint16_t);
+  page_cnt = DIV_ROUND_UP (used_end, PGSIZE);
+
+  vring = palloc_get_multiple (PAL_ZERO, page_cnt);
+  d->slots = palloc_get_page (PAL_ZERO);
+  d->slot_cnt = n / SLOT_DESCS;
+  if (d->slot_cnt > PGSIZE / sizeof *d->slots)
+    d->slot_cnt = PGSIZE / sizeof *d->slots;
+  d->busy_slots = bitmap_create (d->slot_cnt);
+  if (vring == NULL || d->slots == NULL || d->busy_slots == NULL)
+    {
+      palloc_free_multiple (vring, page_cnt);
+      palloc_free_page (d->slots);
+      if (d->busy_slots != NULL)
+        bitmap_destroy (d->busy_slots);
+      return false;
+    }
+  sema_init (&d->free_slots, d->slot_cnt);
+
+  d->queue_size = n;
+  d->desc = (struct vring_desc *) vring;
+  d->avail = (struct vring_avail *) (vring + n * sizeof (struct vring_desc));
+  d->used = (struct vring_used *) (vring + used_ofs);
+  d->last_used = 0;
+  outl (d->io_base + VIRTIO_QUEUE_PFN, vtop (vring) / VRING_ALIGN);
+  return true;
+}
+
+/* Queues request R for device D.  Waits only if every slot is
+   taken. */
+static void
+virtio_blk_submit (void *d_, struct block_request *r)
+{
+  struct virtio_blk *d = d_;
+  enum intr_level old_level;
+  struct vring_desc *desc;
+  struct slot *s;
+  size_t slot;
+
+  sema_down (&d->free_slots);
+  old_level = intr_disable ();
+  slot = bitmap_scan_and_flip (d->busy_slots, 0, 1, false);
+  ASSERT (slot != BITMAP_ERROR);
+
+  s = &d->slots[slot];
+  s->hdr.type = r->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+  s->hdr.reserved = 0;
+  s->hdr.sector = r->sector;
+  s->status = 0xff;
+  s->request = r;
+
+  desc = &d->desc[slot * SLOT_DESCS];
+  desc[0].addr = vtop (&s->hdr);
+  desc[0].len = sizeof s->hdr;
+  desc[0].flags = VRING_DESC_F_NEXT;
+  desc[0].next = slot * SLOT_DESCS + 1;
+  desc[1].addr = vtop (r->buffer);
+  desc[1].len = r->cnt * BLOCK_SECTOR_SIZE;
+  desc[1].flags = VRING_DESC_F_NEXT | (r->write ? 0 : VRING_DESC_F_WRITE);
+  desc[1].next = slot * SLOT_DESCS + 2;
+  desc[2].addr = vtop (&s->status);
+  desc[2].len = sizeof s->status;
+  desc[2].flags = VRING_DESC_F_WRITE;
+  desc[2].next = 0;
+
+  /* The device must see the new entry before the new index. */
+  d->avail->ring[d->avail->idx % d->queue_size] = slot * SLOT_DESCS;
+  barrier ();
+  d->avail->idx++;
+  barrier ();
+  outw (d->io_base + VIRTIO_QUEUE_NOTIFY, 0);
+  intr_set_level (old_level);
+}
+
+/* Transfers CNT sectors starting at SEC_NO between device D and
+   BUFFER, from the device unless WRITE is true, and waits for
+   the transfer to finish. */
+static void
+transfer (struct virtio_blk *d, block_sector_t sec_no, block_sector_t cnt,
+          void *buffer, bool write)
+{
+  struct block_request r;
+
+  block_request_init (&r, sec_no, cnt, buffer, write);
+  virtio_blk_submit (d, &r);
+  block_wait (&r);
+}
+
+/* Reads sector SEC_NO from device D into BUFFER. */
+static void
+virtio_blk_read (void *d, block_sector_t sec_no, void *buffer)
+{
+  transfer (d, sec_no, 1, buffer, false);
+}
+
+/* Writes sector SEC_NO to device D from BUFFER. */
+static void
+virtio_blk_write (void *d, block_sector_t sec_no, const void *buffer)
+{
+  transfer (d, sec_no, 1, (void *) buffer, true);
+}
+
+/* Reads CNT sectors starting at SEC_NO from device D into
+   BUFFER. */
+static void
+virtio_blk_read_multiple (void *d, block_sector_t sec_no, block_sector_t cnt,
+                          void *buffer)
+{
+  transfer (d, sec_no, cnt, buffer, false);
+}
+
+/* Writes CNT sectors starting at SEC_NO to device D from
+   BUFFER. */
+static void
+virtio_blk_write_multiple (void *d, block_sector_t sec_no,
+                           block_sector_t cnt, const void *buffer)
+{
+  transfer (d, sec_no, cnt, (void *) buffer, true);
+}
+
+static struct block_operations virtio_blk_operations =
+  {
+    virtio_blk_read,
+    virtio_blk_write,
+    virtio_blk_read_multiple,
+    virtio_blk_write_multiple,
+    virtio_blk_submit
+  };
+
+/* Completes the requests that device D has finished with. */
+static void
+complete_requests (struct virtio_blk *d)
+{
+  while (d->last_used != d->used->idx)
+    {
+      uint32_t head = d->used->ring[d->last_used % d->queue_size].id;
+      size_t slot = head / SLOT_DESCS;
+      struct slot *s = &d->slots[slot];
+      struct block_request *r = s->request;
+
+      if (s->status != VIRTIO_BLK_S_OK)
+        PANIC ("%s: disk %s failed, sector=%"PRDSNu,
+               d->name, r->write ? "write" : "read", r->sector);
+
+      d->last_used++;
+      bitmap_reset (d->busy_slots, slot);
+      sema_up (&d->free_slots);
+      block_request_done (r);
+    }
+}
+
+/* Virtio block interrupt handler.  Reading the ISR status
+   acknowledges the interrupt. */
+static void
+interrupt_handler (struct intr_frame *f)
+{
+  size_t i;
+
+  for (i = 0; i < device_cnt; i++)
+    {
+      struct virtio_blk *d = &devices[i];
+      if (d->irq == f->vec_no
+          && (inb (d->io_base + VIRTIO_ISR) & ISR_QUEUE) != 0)
+        complete_requests (d);
+    }
+}
@@ -0,0 +1,588 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <stdbool.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Buffer cache.
+
+   Sits between the file system and fs_device.  Holds up to
+   CACHE_SIZE sectors, evicted in clock order.  Writes are
+   absorbed by the cache and written back by a background
+   thread every WRITE_BEHIND_INTERVAL ticks, on eviction, and
+   by cache_done().  An evicted dirty sector is written back
+   outside the cache's global lock, so that hits need not wait
+   for the disk; until the write completes, a miss on that sector
+   waits for it rather than read stale data.  A flush submits a
+   batch of dirty sectors to the block layer before waiting for
+   any of them, so that the disk driver can sort the writes and
+   merge neighbouring sectors into larger transfers.  A second
+   background thread services read-ahead requests so that
+   sequential readers find the next sectors already cached,
+   reading each run of up to CACHE_READ_AHEAD_MAX consecutive
+   sectors with one block_read_multiple().
+
+   Metadata written through cache_write() and cache_write_at()
+   may point to sectors just allocated, so before any of it goes
+   to disk the free map's dirty sectors are written with
+   free_map_sync().  Otherwise a crash could find those sectors
+   in use yet free in the bitmap.  File data, written through
+   cache_write_data() and cache_write_data_at(), needs no such
+   ordering. */
+
+/* Number of sectors held in the cache. */
+#define CACHE_SIZE 64
+
+/* Timer ticks between write-behind passes. */
+#define WRITE_BEHIND_INTERVAL (TIMER_FREQ * 2)
+
+/* Maximum number of pending read-ahead requests. */
+#define READ_AHEAD_MAX 16
+
+/* A cached sector. */
+struct cache_entry
+  {
+    /* Protected by cache_lock. */
+    block_sector_t sector;              /* Sector number, if in_use. */
+    bool in_use;                        /* Holds some sector? */
+    bool accessed;                      /* Used since last clock pass? */
+    int pin_cnt;                        /* Users that hold or await LOCK. */
+    bool in_transit;                    /* Writing back OLD_SECTOR? */
+    block_sector_t old_sector;          /* Previous sector, if in_transit. */
+
+    /* Protected by LOCK. */
+    struct lock lock;                   /* Serializes access to data. */
+    bool valid;                         /* DATA reflects SECTOR? */
+    bool dirty;                         /* DATA newer than disk? */
+    bool ordered;                       /* Write after the free map? */
+    uint8_t data[BLOCK_SECTOR_SIZE];    /* Sector contents. */
+  };
+
+static struct cache_entry cache[CACHE_SIZE];
+static struct lock cache_lock;          /* Protects lookup and eviction. */
+static struct condition cache_changed;  /* An entry was unpinned or
+                                           finished its write back. */
+static size_t clock_hand;               /* Next eviction candidate. */
+
+/* Most entries that cache_flush() pins at once.  Keeping most of
+   the cache unpinned lets a thread that holds one entry's lock
+   while it waits in cache_get() for another, as cache_copy()
+   does, get its entry and let go of the lock the flush wants. */
+#define FLUSH_BATCH 16
+
+/* Write requests for cache_flush(), too big for a kernel stack. */
+static struct lock flush_lock;          /* Serializes cache_flush(). */
+static struct block_request flush_requests[FLUSH_BATCH];
+
+/* Pending read-ahead requests, a ring buffer. */
+struct read_ahead
+  {
+    block_sector_t sector;              /* First sector. */
+    block_sector_t cnt;                 /* Number of sectors. */
+  };
+static struct read_ahead read_ahead_queue[READ_AHEAD_MAX];
+static size_t read_ahead_head;          /* Index of oldest request. */
+static size_t read_ahead_cnt;           /* Number of requests. */
+static struct lock read_ahead_lock;
+static struct condition read_ahead_ready;
+
+/* Read-ahead daemon's buffer for a run of sectors. */
+static uint8_t read_ahead_buf[CACHE_READ_AHEAD_MAX * BLOCK_SECTOR_SIZE];
+
+static thread_func write_behind_daemon NO_RETURN;
+static thread_func read_ahead_daemon NO_RETURN;
+
+/* Initializes the buffer cache and starts its background
+   threads. */
+void
+cache_init (void)
+{
+  size_t i;
+
+  lock_init (&cache_lock);
+  cond_init (&cache_changed);
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      cache[i].in_use = false;
+      cache[i].pin_cnt = 0;
+      cache[i].in_transit = false;
+      cache[i].ordered = false;
+      lock_init (&cache[i].lock);
+    }
+  clock_hand = 0;
+  lock_init (&flush_lock);
+
+  lock_init (&read_ahead_lock);
+  cond_init (&read_ahead_ready);
+  read_ahead_head = read_ahead_cnt = 0;
+
+  thread_create ("cache-flush", PRI_DEFAULT, write_behind_daemon, NULL);
+  thread_create ("cache-ahead", PRI_DEFAULT, read_ahead_daemon, NULL);
+}
+
+/* Returns the entry caching SECTOR, or a null pointer if there
+   is none.  Caller must hold cache_lock. */
+static struct cache_entry *
+lookup (block_sector_t sector)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (cache[i].in_use && cache[i].sector == sector)
+      return &cache[i];
+  return NULL;
+}
+
+/* Returns true if an entry is still writing back the old contents
+   of SECTOR, which must then not be read from disk yet.  Caller
+   must hold cache_lock. */
+static bool
+in_transit (block_sector_t sector)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (cache[i].in_transit && cache[i].old_sector == sector)
+      return true;
+  return false;
+}
+
+/* Chooses an unpinned entry in clock order, reassigns it to
+   SECTOR with invalid data, and returns it pinned.  If the entry
+   held a dirty sector, it is left in transit, to be written back
+   by finish_eviction() once the caller holds the entry's lock.
+   Returns a null pointer if every entry is pinned.  Caller must
+   hold cache_lock. */
+static struct cache_entry *
+evict (block_sector_t sector)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  /* Two passes are enough to clear every accessed bit. */
+  for (i = 0; i < 2 * CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[clock_hand];
+      clock_hand = (clock_hand + 1) % CACHE_SIZE;
+
+      if (e->pin_cnt > 0)
+        continue;
+      if (e->in_use && e->accessed)
+        {
+          e->accessed = false;
+          continue;
+        }
+
+      /* Nobody holds or awaits an unpinned entry's lock, so
+         reading its DIRTY here is safe. */
+      e->in_transit = e->in_use && e->dirty;
+      if (!e->in_transit)
+        e->ordered = false;
+      e->old_sector = e->sector;
+      e->sector = sector;
+      e->in_use = true;
+      e->accessed = true;
+      e->pin_cnt++;
+      e->valid = false;
+      e->dirty = false;
+      return e;
+    }
+  return NULL;
+}
+
+/* Writes back the old sector of entry E, just obtained from
+   evict(), if it is in transit.  The write is done outside
+   cache_lock, so that other cache users need not wait for it,
+   but with E's lock held, so that E's data is not replaced
+   before it is written.  Caller must hold E's lock. */
+static void
+finish_eviction (struct cache_entry *e)
+{
+  ASSERT (lock_held_by_current_thread (&e->lock));
+
+  if (!e->in_transit)
+    return;
+  if (e->ordered)
+    free_map_sync ();
+  block_write (fs_device, e->old_sector, e->data);
+  e->ordered = false;
+
+  lock_acquire (&cache_lock);
+  e->in_transit = false;
+  cond_broadcast (&cache_changed, &cache_lock);
+  lock_release (&cache_lock);
+}
+
+/* Returns the entry for SECTOR, pinned and with its lock held,
+   bringing the sector into the cache if necessary.  If LOAD is
+   false, the caller intends to overwrite the whole sector and
+   the entry's data may be left invalid. */
+static struct cache_entry *
+cache_get (block_sector_t sector, bool load)
+{
+  struct cache_entry *e;
+
+  lock_acquire (&cache_lock);
+  for (;;)
+    {
+      e = lookup (sector);
+      if (e != NULL)
+        {
+          e->pin_cnt++;
+          e->accessed = true;
+          break;
+        }
+      if (!in_transit (sector))
+        {
+          e = evict (sector);
+          if (e != NULL)
+            break;
+        }
+
+      /* SECTOR's old contents are still on their way to disk,
+         or every entry is in use.  Wait for that to change. */
+      cond_wait (&cache_changed, &cache_lock);
+    }
+  lock_release (&cache_lock);
+
+  lock_acquire (&e->lock);
+  finish_eviction (e);
+  if (load && !e->valid)
+    {
+      block_read (fs_device, sector, e->data);
+      e->valid = true;
+    }
+  return e;
+}
+
+/* Like cache_get (SECTOR, false), but never waits for an entry:
+   returns a null pointer if SECTOR is already cached or in
+   transit, or if every entry is pinned.  A newly claimed entry
+   was unpinned, so nobody else holds or awaits its lock. */
+static struct cache_entry *
+cache_try_claim (block_sector_t sector)
+{
+  struct cache_entry *e = NULL;
+
+  lock_acquire (&cache_lock);
+  if (lookup (sector) == NULL && !in_transit (sector))
+    e = evict (sector);
+  lock_release (&cache_lock);
+
+  if (e != NULL)
+    {
+      lock_acquire (&e->lock);
+      finish_eviction (e);
+    }
+  return e;
+}
+
+/* Releases entry E obtained from cache_get(). */
+static void
+cache_put (struct cache_entry *e)
+{
+  lock_release (&e->lock);
+
+  lock_acquire (&cache_lock);
+  ASSERT (e->pin_cnt > 0);
+  if (--e->pin_cnt == 0)
+    cond_broadcast (&cache_changed, &cache_lock);
+  lock_release (&cache_lock);
+}
+
+/* Reads SIZE bytes at byte OFFSET within SECTOR into BUFFER. */
+void
+cache_read_at (block_sector_t sector, void *buffer, off_t size, off_t offset)
+{
+  struct cache_entry *e;
+
+  ASSERT (offset >= 0 && size >= 0 && offset + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_get (sector, true);
+  memcpy (buffer, e->data + offset, size);
+  cache_put (e);
+}
+
+/* Reads SECTOR into BUFFER, which must have room for
+   BLOCK_SECTOR_SIZE bytes. */
+void
+cache_read (block_sector_t sector, void *buffer)
+{
+  cache_read_at (sector, buffer, BLOCK_SECTOR_SIZE, 0);
+}
+
+/* Writes SIZE bytes from BUFFER at byte OFFSET within SECTOR.
+   The write reaches the disk later, after the free map if
+   ORDERED is true. */
+static void
+write_at (block_sector_t sector, const void *buffer, off_t size,
+          off_t offset, bool ordered)
+{
+  struct cache_entry *e;
+
+  ASSERT (offset >= 0 && size >= 0 && offset + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_get (sector, size < BLOCK_SECTOR_SIZE);
+  memcpy (e->data + offset, buffer, size);
+  e->valid = true;
+  e->dirty = true;
+  e->ordered = e->ordered || ordered;
+  cache_put (e);
+}
+
+/* Writes SIZE bytes of metadata from BUFFER at byte OFFSET
+   within SECTOR.  The write reaches the disk later, and not
+   before the free map, since it may point to newly allocated
+   sectors. */
+void
+cache_write_at (block_sector_t sector, const void *buffer,
+                off_t size, off_t offset)
+{
+  write_at (sector, buffer, size, offset, true);
+}
+
+/* Writes BLOCK_SECTOR_SIZE bytes of metadata from BUFFER to
+   SECTOR, like cache_write_at(). */
+void
+cache_write (block_sector_t sector, const void *buffer)
+{
+  write_at (sector, buffer, BLOCK_SECTOR_SIZE, 0, true);
+}
+
+/* Writes SIZE bytes of file data from BUFFER at byte OFFSET
+   within SECTOR.  Unlike metadata, the write may reach the disk
+   in any order. */
+void
+cache_write_data_at (block_sector_t sector, const void *buffer,
+                     off_t size, off_t offset)
+{
+  write_at (sector, buffer, size, offset, false);
+}
+
+/* Writes BLOCK_SECTOR_SIZE bytes of file data from BUFFER to
+   SECTOR, like cache_write_data_at(). */
+void
+cache_write_data (block_sector_t sector, const void *buffer)
+{
+  write_at (sector, buffer, BLOCK_SECTOR_SIZE, 0, false);
+}
+
+/* Copies the contents of file data sector SRC to sector DST
+   within the cache, reading SRC from disk if it is not cached but
+   never reading DST.  The two entries are locked in sector order, so
+   that concurrent copies cannot deadlock. */
+void
+cache_copy (block_sector_t dst, block_sector_t src)
+{
+  struct cache_entry *d, *s;
+
+  if (dst == src)
+    return;
+  if (src < dst)
+    {
+      s = cache_get (src, true);
+      d = cache_get (dst, false);
+    }
+  else
+    {
+      d = cache_get (dst, false);
+      s = cache_get (src, true);
+    }
+  memcpy (d->data, s->data, BLOCK_SECTOR_SIZE);
+  d->valid = true;
+  d->dirty = true;
+  cache_put (s);
+  cache_put (d);
+}
+
+/* Asks for the CNT sectors starting at SECTOR to be brought into
+   the cache in the background.  Does nothing if SECTOR is already
+   cached, since then an earlier request is still ahead of the
+   reader, or if too many requests are pending. */
+void
+cache_read_ahead (block_sector_t sector, block_sector_t cnt)
+{
+  bool cached;
+
+  ASSERT (cnt > 0);
+
+  lock_acquire (&cache_lock);
+  cached = lookup (sector) != NULL;
+  lock_release (&cache_lock);
+  if (cached)
+    return;
+
+  lock_acquire (&read_ahead_lock);
+  if (read_ahead_cnt < READ_AHEAD_MAX)
+    {
+      struct read_ahead *ra = &read_ahead_queue[(read_ahead_head
+                                                 + read_ahead_cnt++)
+                                                % READ_AHEAD_MAX];
+      ra->sector = sector;
+      ra->cnt = cnt < CACHE_READ_AHEAD_MAX ? cnt : CACHE_READ_AHEAD_MAX;
+      cond_signal (&read_ahead_ready, &read_ahead_lock);
+    }
+  lock_release (&read_ahead_lock);
+}
+
+/* Writes every dirty sector in the cache back to disk, and waits
+   for sectors that are being written back by eviction. */
+void
+cache_flush (void)
+{
+  size_t dirty[CACHE_SIZE];             /* Indexes into cache[]. */
+  block_sector_t sectors[CACHE_SIZE];   /* Their sectors. */
+  size_t dirty_cnt = 0;
+  size_t i, j;
+
+  lock_acquire (&flush_lock);
+
+  /* List the dirty entries, sorted by sector. */
+  lock_acquire (&cache_lock);
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      struct cache_entry *e = &cache[i];
+      if (!e->in_use || !e->dirty)
+        continue;
+      for (j = dirty_cnt++; j > 0 && sectors[j - 1] > e->sector; j--)
+        {
+          dirty[j] = dirty[j - 1];
+          sectors[j] = sectors[j - 1];
+        }
+      dirty[j] = i;
+      sectors[j] = e->sector;
+    }
+  lock_release (&cache_lock);
+
+  /* Write them back FLUSH_BATCH at a time.  Within a batch, lock
+     in sector order, like cache_copy(), and queue all the writes
+     before waiting for the first. */
+  for (i = 0; i < dirty_cnt; i = j)
+    {
+      struct cache_entry *batch[FLUSH_BATCH];
+      size_t batch_cnt = 0;
+      bool ordered;
+      size_t k;
+
+      /* Skip entries evicted or reused since they were listed. */
+      lock_acquire (&cache_lock);
+      for (j = i; j < dirty_cnt && j - i < FLUSH_BATCH; j++)
+        {
+          struct cache_entry *e = &cache[dirty[j]];
+          if (e->in_use && e->sector == sectors[j] && e->dirty)
+            {
+              e->pin_cnt++;
+              batch[batch_cnt++] = e;
+            }
+        }
+      lock_release (&cache_lock);
+
+      ordered = false;
+      for (k = 0; k < batch_cnt; k++)
+        {
+          lock_acquire (&batch[k]->lock);
+          ordered = ordered || batch[k]->ordered;
+        }
+      if (ordered)
+        free_map_sync ();
+      for (k = 0; k < batch_cnt; k++)
+        {
+          struct cache_entry *e = batch[k];
+          block_request_init (&flush_requests[k], e->sector, 1, e->data,
+                              true);
+          block_submit (fs_device, &flush_requests[k]);
+        }
+      for (k = 0; k < batch_cnt; k++)
+        {
+          block_wait (&flush_requests[k]);
+          batch[k]->dirty = false;
+          batch[k]->ordered = false;
+          cache_put (batch[k]);
+        }
+    }
+
+  /* Sectors evicted meanwhile are written by their evictors.
+     Wait for those writes too. */
+  lock_acquire (&cache_lock);
+  for (i = 0; i < CACHE_SIZE; i++)
+    while (cache[i].in_transit)
+      cond_wait (&cache_changed, &cache_lock);
+  lock_release (&cache_lock);
+
+  lock_release (&flush_lock);
+}
+
+/* Shuts down the cache, writing back all dirty sectors.
+   Nothing can be written if we got here through a kernel panic,
+   because the disk driver needs interrupts turned on. */
+void
+cache_done (void)
+{
+  if (intr_get_level () == INTR_ON)
+    cache_flush ();
+}
+
+/* Background thread that periodically writes dirty sectors
+   back to disk, so that a crash loses at most a few seconds of
+   writes.  Goes through the free map's checkpoint, which also
+   writes the free map and recycles released sectors. */
+static void
+write_behind_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (WRITE_BEHIND_INTERVAL);
+      free_map_checkpoint ();
+    }
+}
+
+/* Background thread that reads queued runs of sectors into the
+   cache.  A run stops short at the first sector that is already
+   cached or for which no entry is free, and the rest is read with
+   a single request. */
+static void
+read_ahead_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      struct cache_entry *run[CACHE_READ_AHEAD_MAX];
+      struct read_ahead ra;
+      block_sector_t i, n;
+
+      lock_acquire (&read_ahead_lock);
+      while (read_ahead_cnt == 0)
+        cond_wait (&read_ahead_ready, &read_ahead_lock);
+      ra = read_ahead_queue[read_ahead_head];
+      read_ahead_head = (read_ahead_head + 1) % READ_AHEAD_MAX;
+      read_ahead_cnt--;
+      lock_release (&read_ahead_lock);
+
+      for (n = 0; n < ra.cnt; n++)
+        {
+          run[n] = cache_try_claim (ra.sector + n);
+          if (run[n] == NULL)
+            break;
+        }
+      if (n == 0)
+        continue;
+
+      block_read_multiple (fs_device, ra.sector, n, read_ahead_buf);
+      for (i = 0; i < n; i++)
+        {
+          memcpy (run[i]->data, read_ahead_buf + i * BLOCK_SECTOR_SIZE,
+                  BLOCK_SECTOR_SIZE);
+          run[i]->valid = true;
+          cache_put (run[i]);
+        }
+    }
+}
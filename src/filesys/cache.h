@@ -0,0 +1,24 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include "devices/block.h"
+#include "filesys/off_t.h"
+
+/* Most sectors read ahead by a single request. */
+#define CACHE_READ_AHEAD_MAX 8
+
+void cache_init (void);
+void cache_flush (void);
+void cache_done (void);
+
+void cache_read (block_sector_t, void *);
+void cache_read_at (block_sector_t, void *, off_t size, off_t offset);
+void cache_write (block_sector_t, const void *);
+void cache_write_at (block_sector_t, const void *, off_t size, off_t offset);
+void cache_write_data (block_sector_t, const void *);
+void cache_write_data_at (block_sector_t, const void *,
+                          off_t size, off_t offset);
+void cache_read_ahead (block_sector_t, block_sector_t cnt);
+void cache_copy (block_sector_t dst, block_sector_t src);
+
+#endif /* filesys/cache.h */
@@ -0,0 +1,201 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/synch.h"
+
+/* Directory entry cache.
+
+   Maps a (directory inode sector, name) pair to the sector of the
+   inode that the name refers to, so that resolving a path does
+   not have to read every directory along the way.  Failed lookups
+   are cached too, as negative entries with sector 0, which holds
+   the free map and never belongs to a named file.
+
+   A lookup that misses reads the directory and then calls
+   dcache_fill().  Changes to a directory call dcache_invalidate()
+   after they are written, which bumps a generation number; a fill
+   that started before the change is then discarded, so it cannot
+   cache what the directory held before the change. */
+
+/* Maximum number of cached entries. */
+#define DCACHE_SIZE 128
+
+/* A cached directory entry. */
+struct dentry
+  {
+    block_sector_t parent;              /* Directory's inode sector. */
+    char name[NAME_MAX + 1];            /* Name within the directory. */
+    block_sector_t sector;              /* Named inode's sector, or 0. */
+    struct hash_elem hash_elem;         /* Element in dentry_table. */
+    struct list_elem lru_elem;          /* Element in lru_list. */
+  };
+
+static struct dentry dentries[DCACHE_SIZE];
+static struct hash dentry_table;        /* Cached entries. */
+static struct list lru_list;            /* Cached entries, most recent first. */
+static struct list free_list;           /* Unused entries. */
+static unsigned generation;             /* Bumped on every invalidation. */
+static struct lock dcache_lock;         /* Protects all of the above. */
+
+static hash_hash_func dentry_hash;
+static hash_less_func dentry_less;
+
+/* Initializes the directory entry cache. */
+void
+dcache_init (void)
+{
+  size_t i;
+
+  if (!hash_init (&dentry_table, dentry_hash, dentry_less, NULL))
+    PANIC ("dcache: hash table creation failed");
+  list_init (&lru_list);
+  list_init (&free_list);
+  for (i = 0; i < DCACHE_SIZE; i++)
+    list_push_back (&free_list, &dentries[i].lru_elem);
+  generation = 0;
+  lock_init (&dcache_lock);
+}
+
+/* Returns the cached entry for NAME in directory PARENT, or a
+   null pointer if there is none.  Caller must hold dcache_lock. */
+static struct dentry *
+find (block_sector_t parent, const char *name)
+{
+  struct dentry key;
+  struct hash_elem *e;
+
+  key.parent = parent;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&dentry_table, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct dentry, hash_elem) : NULL;
+}
+
+/* Drops entry D from the cache.  Caller must hold dcache_lock. */
+static void
+discard (struct dentry *d)
+{
+  hash_delete (&dentry_table, &d->hash_elem);
+  list_remove (&d->lru_elem);
+  list_push_back (&free_list, &d->lru_elem);
+}
+
+/* Looks up NAME in directory PARENT.  If it is cached, stores the
+   named inode's sector in *SECTORP, or 0 if NAME is known not to
+   exist, and returns true.  Otherwise, stores the generation to
+   pass to dcache_fill() in *GENP and returns false. */
+bool
+dcache_lookup (block_sector_t parent, const char *name,
+               block_sector_t *sectorp, unsigned *genp)
+{
+  struct dentry *d;
+
+  if (strlen (name) > NAME_MAX)
+    return false;
+
+  lock_acquire (&dcache_lock);
+  d = find (parent, name);
+  if (d != NULL)
+    {
+      *sectorp = d->sector;
+      list_remove (&d->lru_elem);
+      list_push_front (&lru_list, &d->lru_elem);
+    }
+  else
+    *genp = generation;
+  lock_release (&dcache_lock);
+
+  return d != NULL;
+}
+
+/* Records that NAME in directory PARENT refers to SECTOR, or does
+   not exist if SECTOR is 0, as found by a lookup that missed in
+   the cache at generation GEN.  Does nothing if the cache has
+   been invalidated since then. */
+void
+dcache_fill (block_sector_t parent, const char *name,
+             block_sector_t sector, unsigned gen)
+{
+  struct dentry *d;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  lock_acquire (&dcache_lock);
+  if (gen == generation && find (parent, name) == NULL)
+    {
+      if (!list_empty (&free_list))
+        d = list_entry (list_pop_front (&free_list), struct dentry, lru_elem);
+      else
+        {
+          d = list_entry (list_back (&lru_list), struct dentry, lru_elem);
+          hash_delete (&dentry_table, &d->hash_elem);
+          list_remove (&d->lru_elem);
+        }
+      d->parent = parent;
+      strlcpy (d->name, name, sizeof d->name);
+      d->sector = sector;
+      hash_insert (&dentry_table, &d->hash_elem);
+      list_push_front (&lru_list, &d->lru_elem);
+    }
+  lock_release (&dcache_lock);
+}
+
+/* Forgets anything cached about NAME in directory PARENT.  Must
+   be called after NAME is added to or removed from PARENT. */
+void
+dcache_invalidate (block_sector_t parent, const char *name)
+{
+  struct dentry *d;
+
+  lock_acquire (&dcache_lock);
+  generation++;
+  if (strlen (name) <= NAME_MAX)
+    {
+      d = find (parent, name);
+      if (d != NULL)
+        discard (d);
+    }
+  lock_release (&dcache_lock);
+}
+
+/* Forgets every cached entry in directory PARENT.  Must be called
+   when PARENT is removed, before its sector can be reused. */
+void
+dcache_invalidate_dir (block_sector_t parent)
+{
+  size_t i;
+
+  lock_acquire (&dcache_lock);
+  generation++;
+  for (i = 0; i < DCACHE_SIZE; i++)
+    {
+      struct dentry *d = &dentries[i];
+      if (d->parent == parent && find (d->parent, d->name) == d)
+        discard (d);
+    }
+  lock_release (&dcache_lock);
+}
+
+/* Returns a hash value for dentry D. */
+static unsigned
+dentry_hash (const struct hash_elem *d_, void *aux UNUSED)
+{
+  const struct dentry *d = hash_entry (d_, struct dentry, hash_elem);
+  return hash_string (d->name) ^ hash_int (d->parent);
+}
+
+/* Returns true if dentry A precedes dentry B. */
+static bool
+dentry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+             void *aux UNUSED)
+{
+  const struct dentry *a = hash_entry (a_, struct dentry, hash_elem);
+  const struct dentry *b = hash_entry (b_, struct dentry, hash_elem);
+
+  if (a->parent != b->parent)
+    return a->parent < b->parent;
+  return strcmp (a->name, b->name) < 0;
+}
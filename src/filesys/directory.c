@@ -1,8 +1,12 @@
 #include "filesys/directory.h"
+#include <hash.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 #include <list.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
+#include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 
@@ -13,26 +17,166 @@ struct dir
     off_t pos;                          /* Current position. */
   };
 
+/* On-disk directory format.
+
+   A directory file starts with a one-sector header, followed by
+   an array of entry slots numbered from 1.  Entries in use are
+   chained into BUCKET_CNT hash buckets by name, and unused slots
+   are chained into a free list, both through each entry's NEXT
+   member; slot 0 ends a chain.  Lookups thus read one bucket head
+   and a short chain instead of the whole directory, while
+   dir_readdir() still walks the slots in order, so an entry keeps
+   its place in the listing for as long as it exists. */
+
+/* Identifies a directory header. */
+#define DIR_MAGIC 0x48524944
+
+/* Number of hash buckets. */
+#define BUCKET_CNT 126
+
+/* Directory header.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct dir_header
+  {
+    uint32_t magic;                     /* DIR_MAGIC. */
+    uint32_t free_slot;                 /* First unused slot, or 0. */
+    uint32_t buckets[BUCKET_CNT];       /* First slot in each bucket. */
+  };
+
 /* A single directory entry. */
 struct dir_entry 
   {
     block_sector_t inode_sector;        /* Sector number of header. */
     char name[NAME_MAX + 1];            /* Null terminated file name. */
     bool in_use;                        /* In use or free? */
+    uint32_t next;                      /* Next slot in chain, or 0. */
   };
 
+/* Returns the byte offset of SLOT within a directory. */
+static inline off_t
+slot_to_ofs (uint32_t slot)
+{
+  ASSERT (slot > 0);
+  return sizeof (struct dir_header) + (slot - 1) * sizeof (struct dir_entry);
+}
+
+/* Reads header field FIELD of DIR into *VALUE.  Returns true if
+   successful, false on failure. */
+#define read_header(DIR, FIELD, VALUE)                                  \
+        (inode_read_at ((DIR)->inode, (VALUE), sizeof (uint32_t),       \
+                        offsetof (struct dir_header, FIELD))            \
+         == sizeof (uint32_t))
+
+/* Writes *VALUE to header field FIELD of DIR.  Returns true if
+   successful, false on failure. */
+#define write_header(DIR, FIELD, VALUE)                                 \
+        (inode_write_at ((DIR)->inode, (VALUE), sizeof (uint32_t),      \
+                         offsetof (struct dir_header, FIELD))           \
+         == sizeof (uint32_t))
+
+/* Reads SLOT of DIR into *E.  Returns true if successful, false
+   if SLOT is past the end of DIR. */
+static bool
+read_slot (const struct dir *dir, uint32_t slot, struct dir_entry *e)
+{
+  return (inode_read_at (dir->inode, e, sizeof *e, slot_to_ofs (slot))
+          == sizeof *e);
+}
+
+/* Writes *E to SLOT of DIR, extending DIR if necessary.  Returns
+   true if successful, false on failure. */
+static bool
+write_slot (struct dir *dir, uint32_t slot, const struct dir_entry *e)
+{
+  return (inode_write_at (dir->inode, e, sizeof *e, slot_to_ofs (slot))
+          == sizeof *e);
+}
+
+static struct dir *dir_open_raw (struct inode *);
+
+/* Returns the hash bucket for NAME. */
+static inline size_t
+name_to_bucket (const char *name)
+{
+  return hash_string (name) % BUCKET_CNT;
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+   given SECTOR, with "." and ".." entries that refer to the
+   directory itself and to the directory in PARENT_SECTOR.  The
+   root directory is its own parent.  Returns true if successful,
+   false on failure, in which case SECTOR and any sectors
+   allocated for the directory's contents have been released. */
 bool
-dir_create (block_sector_t sector, size_t entry_cnt)
+dir_create (block_sector_t sector, block_sector_t parent_sector,
+            size_t entry_cnt)
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  struct dir_header *h;
+  struct inode *inode;
+  struct dir *dir;
+  bool success;
+  size_t i;
+
+  ASSERT (sizeof *h == BLOCK_SECTOR_SIZE);
+
+  if (!inode_create (sector, slot_to_ofs (entry_cnt + 1), true))
+    {
+      free_map_release (sector, 1);
+      return false;
+    }
+  inode = inode_open (sector);
+  if (inode == NULL)
+    {
+      inode_release (sector);
+      return false;
+    }
+  dir = dir_open_raw (inode_reopen (inode));
+  success = dir != NULL;
+
+  /* Chain the preallocated slots into the free list. */
+  h = success ? calloc (1, sizeof *h) : NULL;
+  success = h != NULL;
+  if (success)
+    {
+      h->magic = DIR_MAGIC;
+      h->free_slot = entry_cnt > 0 ? 1 : 0;
+      success = inode_write_at (dir->inode, h, sizeof *h, 0) == sizeof *h;
+      free (h);
+    }
+  for (i = 1; success && i < entry_cnt; i++)
+    {
+      struct dir_entry e;
+
+      memset (&e, 0, sizeof e);
+      e.next = i + 1;
+      success = write_slot (dir, i, &e);
+    }
+
+  success = (success
+             && dir_add (dir, ".", sector)
+             && dir_add (dir, "..", parent_sector));
+  dir_close (dir);
+
+  /* Removing the inode releases its sector and contents when it
+     is closed. */
+  if (!success)
+    inode_remove (inode);
+  inode_close (inode);
+  return success;
+}
+
+/* Returns true if NAME is "." or "..", false otherwise. */
+static bool
+is_dot_name (const char *name)
+{
+  return !strcmp (name, ".") || !strcmp (name, "..");
 }
 
 /* Opens and returns the directory for the given INODE, of which
-   it takes ownership.  Returns a null pointer on failure. */
-struct dir *
-dir_open (struct inode *inode) 
+   it takes ownership, without checking that it is a directory.
+   Returns a null pointer on failure. */
+static struct dir *
+dir_open_raw (struct inode *inode) 
 {
   struct dir *dir = calloc (1, sizeof *dir);
   if (inode != NULL && dir != NULL)
@@ -49,6 +193,24 @@ dir_open (struct inode *inode)
     }
 }
 
+/* Opens and returns the directory for the given INODE, of which
+   it takes ownership.  Returns a null pointer on failure, or if
+   INODE does not hold a directory. */
+struct dir *
+dir_open (struct inode *inode) 
+{
+  struct dir *dir = dir_open_raw (inode);
+  uint32_t magic;
+
+  if (dir != NULL
+      && (!read_header (dir, magic, &magic) || magic != DIR_MAGIC))
+    {
+      dir_close (dir);
+      return NULL;
+    }
+  return dir;
+}
+
 /* Opens the root directory and returns a directory for it.
    Return true if successful, false on failure. */
 struct dir *
@@ -85,27 +247,32 @@ dir_get_inode (struct dir *dir)
 
 /* Searches DIR for a file with the given NAME.
    If successful, returns true, sets *EP to the directory entry
-   if EP is non-null, and sets *OFSP to the byte offset of the
-   directory entry if OFSP is non-null.
-   otherwise, returns false and ignores EP and OFSP. */
+   if EP is non-null, sets *SLOTP to its slot if SLOTP is
+   non-null, and sets *PREVP to the slot before it in its hash
+   chain, or 0 if it is first, if PREVP is non-null.
+   otherwise, returns false and ignores EP, SLOTP, and PREVP. */
 static bool
 lookup (const struct dir *dir, const char *name,
-        struct dir_entry *ep, off_t *ofsp) 
+        struct dir_entry *ep, uint32_t *slotp, uint32_t *prevp) 
 {
   struct dir_entry e;
-  size_t ofs;
+  uint32_t prev = 0;
+  uint32_t slot;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
+  if (!read_header (dir, buckets[name_to_bucket (name)], &slot))
+    return false;
+  for (; slot != 0 && read_slot (dir, slot, &e); prev = slot, slot = e.next)
     if (e.in_use && !strcmp (name, e.name)) 
       {
         if (ep != NULL)
           *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
+        if (slotp != NULL)
+          *slotp = slot;
+        if (prevp != NULL)
+          *prevp = prev;
         return true;
       }
   return false;
@@ -114,21 +281,37 @@ lookup (const struct dir *dir, const char *name,
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
    On success, sets *INODE to an inode for the file, otherwise to
-   a null pointer.  The caller must close *INODE. */
+   a null pointer.  The caller must close *INODE.
+   Lookups are answered from the directory entry cache when
+   possible, without taking DIR's lock.  A directory that has
+   been removed contains nothing. */
 bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
-  struct dir_entry e;
+  block_sector_t parent, sector;
+  unsigned gen;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
-  else
-    *inode = NULL;
+  *inode = NULL;
+  if (inode_is_removed (dir->inode))
+    return false;
 
+  parent = inode_get_inumber (dir->inode);
+  if (!dcache_lookup (parent, name, &sector, &gen))
+    {
+      struct dir_entry e;
+
+      inode_lock_dir (dir->inode);
+      sector = lookup (dir, name, &e, NULL, NULL) ? e.inode_sector : 0;
+      dcache_fill (parent, name, sector, gen);
+      inode_unlock_dir (dir->inode);
+    }
+
+  if (sector != 0)
+    *inode = inode_open (sector);
   return *inode != NULL;
 }
 
@@ -142,7 +325,8 @@ bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
   struct dir_entry e;
-  off_t ofs;
+  size_t bucket;
+  uint32_t slot;
   bool success = false;
 
   ASSERT (dir != NULL);
@@ -152,48 +336,85 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   if (*name == '\0' || strlen (name) > NAME_MAX)
     return false;
 
+  /* Nothing can be added to a removed directory.  dir_remove()
+     marks a directory removed while holding its lock. */
+  inode_lock_dir (dir->inode);
+  if (inode_is_removed (dir->inode))
+    goto done;
+
   /* Check that NAME is not in use. */
-  if (lookup (dir, name, NULL, NULL))
+  if (lookup (dir, name, NULL, NULL, NULL))
     goto done;
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
-     
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
-
-  /* Write slot. */
+  /* Take a slot off the free list, or add one at the end of the
+     directory if the free list is empty. */
+  if (!read_header (dir, free_slot, &slot))
+    goto done;
+  if (slot != 0)
+    {
+      if (!read_slot (dir, slot, &e) || !write_header (dir, free_slot, &e.next))
+        goto done;
+    }
+  else
+    slot = ((inode_length (dir->inode) - sizeof (struct dir_header))
+            / sizeof e + 1);
+
+  /* Write slot at the head of NAME's bucket. */
+  bucket = name_to_bucket (name);
   e.in_use = true;
   strlcpy (e.name, name, sizeof e.name);
   e.inode_sector = inode_sector;
-  success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  success = (read_header (dir, buckets[bucket], &e.next)
+             && write_slot (dir, slot, &e)
+             && write_header (dir, buckets[bucket], &slot));
+  dcache_invalidate (inode_get_inumber (dir->inode), name);
 
  done:
+  inode_unlock_dir (dir->inode);
   return success;
 }
 
+/* Returns true if DIR contains no entries other than "." and "..",
+   false otherwise. */
+static bool
+dir_is_empty (const struct dir *dir)
+{
+  struct dir_entry e;
+  uint32_t slot;
+
+  for (slot = 1; read_slot (dir, slot, &e); slot++)
+    if (e.in_use && !is_dot_name (e.name))
+      return false;
+  return true;
+}
+
 /* Removes any entry for NAME in DIR.
-   Returns true if successful, false on failure,
-   which occurs only if there is no file with the given NAME. */
+   Returns true if successful, false on failure, which occurs if
+   there is no file with the given NAME, if NAME is "." or "..",
+   or if NAME is a directory that is not empty.
+   Takes DIR's lock and then, if NAME is a directory, its lock,
+   so that nothing is added to it between checking that it is
+   empty and removing it. */
 bool
 dir_remove (struct dir *dir, const char *name) 
 {
   struct dir_entry e;
   struct inode *inode = NULL;
+  bool child_locked = false;
   bool success = false;
-  off_t ofs;
+  uint32_t slot, prev;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  /* A directory's own entries cannot be removed. */
+  if (is_dot_name (name))
+    return false;
+
+  inode_lock_dir (dir->inode);
+
   /* Find directory entry. */
-  if (!lookup (dir, name, &e, &ofs))
+  if (!lookup (dir, name, &e, &slot, &prev))
     goto done;
 
   /* Open inode. */
@@ -201,36 +422,100 @@ dir_remove (struct dir *dir, const char *name)
   if (inode == NULL)
     goto done;
 
-  /* Erase directory entry. */
+  /* Only empty directories may be removed. */
+  if (inode_is_dir (inode))
+    {
+      struct dir *child;
+      bool empty;
+
+      inode_lock_dir (inode);
+      child_locked = true;
+      child = dir_open (inode_reopen (inode));
+      empty = child != NULL && dir_is_empty (child);
+      dir_close (child);
+      if (!empty)
+        goto done;
+    }
+
+  /* Unlink directory entry from its bucket. */
+  if (prev == 0)
+    {
+      if (!write_header (dir, buckets[name_to_bucket (name)], &e.next))
+        goto done;
+    }
+  else
+    {
+      struct dir_entry prev_e;
+      if (!read_slot (dir, prev, &prev_e))
+        goto done;
+      prev_e.next = e.next;
+      if (!write_slot (dir, prev, &prev_e))
+        goto done;
+    }
+
+  /* Erase directory entry and put its slot on the free list. */
   e.in_use = false;
-  if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
+  if (!read_header (dir, free_slot, &e.next)
+      || !write_slot (dir, slot, &e)
+      || !write_header (dir, free_slot, &slot))
     goto done;
+  dcache_invalidate (inode_get_inumber (dir->inode), name);
 
   /* Remove inode. */
   inode_remove (inode);
+  if (inode_is_dir (inode))
+    dcache_invalidate_dir (inode_get_inumber (inode));
   success = true;
 
  done:
+  if (child_locked)
+    inode_unlock_dir (inode);
+  inode_unlock_dir (dir->inode);
   inode_close (inode);
   return success;
 }
 
 /* Reads the next directory entry in DIR and stores the name in
    NAME.  Returns true if successful, false if the directory
-   contains no more entries. */
+   contains no more entries.  "." and ".." are skipped. */
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
   struct dir_entry e;
+  bool found = false;
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
+  inode_lock_dir (dir->inode);
+  if (dir->pos < (off_t) sizeof (struct dir_header))
+    dir->pos = sizeof (struct dir_header);
+  while (!found
+         && inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
     {
       dir->pos += sizeof e;
-      if (e.in_use)
+      if (e.in_use && !is_dot_name (e.name))
         {
           strlcpy (name, e.name, NAME_MAX + 1);
-          return true;
+          found = true;
         } 
     }
-  return false;
+  inode_unlock_dir (dir->inode);
+  return found;
+}
+
+/* Sets the position in DIR from which dir_readdir() continues to
+   POS, a value previously returned by dir_tell(). */
+void
+dir_seek (struct dir *dir, off_t pos)
+{
+  ASSERT (dir != NULL);
+  ASSERT (pos >= 0);
+  dir->pos = pos;
+}
+
+/* Returns the position in DIR from which dir_readdir()
+   continues. */
+off_t
+dir_tell (struct dir *dir)
+{
+  ASSERT (dir != NULL);
+  return dir->pos;
 }
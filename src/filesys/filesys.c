@@ -2,10 +2,13 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
+#include "filesys/dcache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "threads/thread.h"
 
 /* Partition that contains the file system. */
 struct block *fs_device;
@@ -21,7 +24,9 @@ filesys_init (bool format)
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
 
+  cache_init ();
   inode_init ();
+  dcache_init ();
   free_map_init ();
 
   if (format) 
@@ -36,8 +41,139 @@ void
 filesys_done (void) 
 {
   free_map_close ();
+  cache_done ();
 }
 
+/* Extracts a file name part from *SRCP into PART, and updates
+   *SRCP so that the next call will return the next file name
+   part.  Returns 1 if successful, 0 at end of string, -1 for a
+   too-long file name part. */
+static int
+get_next_part (char part[NAME_MAX + 1], const char **srcp)
+{
+  const char *src = *srcp;
+  char *dst = part;
+
+  /* Skip leading slashes.  If it's all slashes, we're done. */
+  while (*src == '/')
+    src++;
+  if (*src == '\0')
+    return 0;
+
+  /* Copy up to NAME_MAX characters from SRC to DST.  Add null
+     terminator. */
+  while (*src != '/' && *src != '\0')
+    {
+      if (dst < part + NAME_MAX)
+        *dst++ = *src;
+      else
+        return -1;
+      src++;
+    }
+  *dst = '\0';
+
+  /* Advance source pointer. */
+  *srcp = src;
+  return 1;
+}
+
+/* Opens the directory in which PATH's final component lives and
+   stores that component in NAME.  Absolute paths start at the
+   root directory, relative paths at the running thread's current
+   directory.  A path that names the root directory yields the
+   root and ".".  Returns a null pointer if PATH is empty, a
+   component is too long, or a directory along the way does not
+   exist. */
+static struct dir *
+resolve_parent (const char *path, char name[NAME_MAX + 1])
+{
+  struct dir *cwd = thread_current ()->cwd;
+  struct dir *dir;
+  char next[NAME_MAX + 1];
+  int result;
+
+  if (*path == '\0')
+    return NULL;
+  if (*path == '/' || cwd == NULL)
+    dir = dir_open_root ();
+  else
+    dir = dir_reopen (cwd);
+  if (dir == NULL)
+    return NULL;
+
+  result = get_next_part (name, &path);
+  if (result == 0)
+    strlcpy (name, ".", NAME_MAX + 1);
+
+  /* NAME holds the component just read.  If another follows,
+     NAME must be a directory, and we descend into it. */
+  while (result > 0 && (result = get_next_part (next, &path)) > 0)
+    {
+      struct inode *inode;
+
+      if (!dir_lookup (dir, name, &inode) || !inode_is_dir (inode))
+        {
+          inode_close (inode);
+          result = -1;
+          break;
+        }
+      dir_close (dir);
+      dir = dir_open (inode);
+      if (dir == NULL)
+        return NULL;
+      strlcpy (name, next, NAME_MAX + 1);
+    }
+
+  if (result < 0)
+    {
+      dir_close (dir);
+      return NULL;
+    }
+  return dir;
+}
+
+/* Creates a file or, if IS_DIR is true, a directory named PATH.
+   A file gets INITIAL_SIZE bytes.  Returns true if successful,
+   false otherwise. */
+static bool
+create (const char *path, off_t initial_size, bool is_dir)
+{
+  block_sector_t inode_sector;
+  char name[NAME_MAX + 1];
+  struct dir *dir = resolve_parent (path, name);
+  bool success = false;
+
+  if (dir != NULL && free_map_allocate (1, &inode_sector))
+    {
+      if (is_dir)
+        success = dir_create (inode_sector,
+                              inode_get_inumber (dir_get_inode (dir)),
+                              initial_size);
+      else
+        {
+          success = inode_create (inode_sector, initial_size, false);
+          if (!success)
+            free_map_release (inode_sector, 1);
+        }
+
+      /* Once the inode exists, release it through the inode so
+         that its data sectors go too. */
+      if (success && !dir_add (dir, name, inode_sector))
+        {
+          struct inode *inode = inode_open (inode_sector);
+          if (inode != NULL)
+            {
+              inode_remove (inode);
+              inode_close (inode);
+            }
+          success = false;
+        }
+    }
+  dir_close (dir);
+
+  return success;
+}
+
 /* Creates a file named NAME with the given INITIAL_SIZE.
    Returns true if successful, false otherwise.
    Fails if a file named NAME already exists,
@@ -45,20 +181,21 @@ filesys_done (void)
 bool
 filesys_create (const char *name, off_t initial_size) 
 {
-  block_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_root ();
-  bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size)
-                  && dir_add (dir, name, inode_sector));
-  if (!success && inode_sector != 0) 
-    free_map_release (inode_sector, 1);
-  dir_close (dir);
+  return create (name, initial_size, false);
+}
 
-  return success;
+/* Creates a directory named NAME.
+   Returns true if successful, false otherwise.
+   Fails if a file named NAME already exists, if a directory
+   along the way does not exist, or if internal memory allocation
+   fails. */
+bool
+filesys_mkdir (const char *name)
+{
+  return create (name, 16, true);
 }
 
-/* Opens the file with the given NAME.
+/* Opens the file or directory with the given NAME.
    Returns the new file if successful or a null pointer
    otherwise.
    Fails if no file named NAME exists,
@@ -66,37 +203,68 @@ filesys_create (const char *name, off_t initial_size)
 struct file *
 filesys_open (const char *name)
 {
-  struct dir *dir = dir_open_root ();
+  char part[NAME_MAX + 1];
+  struct dir *dir = resolve_parent (name, part);
   struct inode *inode = NULL;
 
   if (dir != NULL)
-    dir_lookup (dir, name, &inode);
+    dir_lookup (dir, part, &inode);
   dir_close (dir);
 
   return file_open (inode);
 }
 
-/* Deletes the file named NAME.
+/* Deletes the file or empty directory named NAME.
    Returns true if successful, false on failure.
-   Fails if no file named NAME exists,
-   or if an internal memory allocation fails. */
+   Fails if no file named NAME exists, if NAME is a directory that
+   is not empty, or if an internal memory allocation fails. */
 bool
 filesys_remove (const char *name) 
 {
-  struct dir *dir = dir_open_root ();
-  bool success = dir != NULL && dir_remove (dir, name);
+  char part[NAME_MAX + 1];
+  struct dir *dir = resolve_parent (name, part);
+  bool success = dir != NULL && dir_remove (dir, part);
   dir_close (dir); 
 
   return success;
 }
-
+
+/* Makes the directory named NAME the running thread's current
+   directory.  Returns true if successful, false if NAME does not
+   exist or is not a directory. */
+bool
+filesys_chdir (const char *name)
+{
+  struct thread *t = thread_current ();
+  char part[NAME_MAX + 1];
+  struct dir *dir = resolve_parent (name, part);
+  struct inode *inode = NULL;
+
+  if (dir != NULL)
+    dir_lookup (dir, part, &inode);
+  dir_close (dir);
+
+  if (inode == NULL || !inode_is_dir (inode))
+    {
+      inode_close (inode);
+      return false;
+    }
+  dir = dir_open (inode);
+  if (dir == NULL)
+    return false;
+
+  dir_close (t->cwd);
+  t->cwd = dir;
+  return true;
+}
+
 /* Formats the file system. */
 static void
 do_format (void)
 {
   printf ("Formatting file system...");
   free_map_create ();
-  if (!dir_create (ROOT_DIR_SECTOR, 16))
+  if (!dir_create (ROOT_DIR_SECTOR, ROOT_DIR_SECTOR, 16))
     PANIC ("root directory creation failed");
   free_map_close ();
   printf ("done.\n");
@@ -1,85 +1,588 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <round.h>
+#include <string.h>
+#include "filesys/cache.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static struct lock free_map_lock;    /* Protects the free map and extents. */
+
+/* Write-back of the free map.
+
+   Allocating or releasing sectors only changes the in-memory free
+   map and marks the sectors of the free map file that hold the
+   changed bits in DIRTY_SECTORS.  free_map_sync() writes just
+   those sectors, straight to their places on disk, found once in
+   MAP_SECTORS when the file is opened, rather than through the
+   buffer cache.  The cache calls it before it writes back any
+   metadata that might point to newly allocated sectors, so that a
+   crash never finds a sector in use on disk yet free in the
+   bitmap.  The bits of many allocations thus usually reach the
+   disk in one write, at a checkpoint or when an inode or index
+   block is evicted.
+
+   Released sectors are not reused right away.  They wait in
+   PENDING_RELEASES until a checkpoint has flushed the buffer
+   cache, which writes the inodes that stopped referring to them,
+   and only then go back into the free map.  Otherwise a crash
+   could find a sector both free in the bitmap and still pointed
+   to by the old inode on disk, or reused by another file while
+   it was. */
+
+/* Number of free map bits stored in one sector of its file. */
+#define BITS_PER_SECTOR (BLOCK_SECTOR_SIZE * 8)
+
+static struct bitmap *dirty_sectors;    /* Free map file sectors to write. */
+static block_sector_t *map_sectors;     /* Their places on disk, once open. */
+static uint8_t sector_buf[BLOCK_SECTOR_SIZE]; /* Under free_map_lock. */
+static struct list pending_releases;    /* Released extents, by size_elem. */
+
+/* Free extents.
+
+   The free map file is the on-disk record of free space, but
+   allocation is done from an in-memory index of the maximal runs
+   of free sectors, built from the bitmap when it is loaded.  Each
+   extent is found by its first sector and by the sector just past
+   it, so that a released run merges with its neighbors in
+   constant time, and is kept in a list for its size class, so
+   that best-fit allocation only looks at extents of about the
+   right size.  Allocating at a hint, typically the sector after
+   a file's previous block, keeps sequential files contiguous. */
+
+/* A run of free sectors. */
+struct extent
+  {
+    block_sector_t start;               /* First sector. */
+    size_t cnt;                         /* Number of sectors. */
+    struct hash_elem start_elem;        /* Element in extents_by_start. */
+    struct hash_elem end_elem;          /* Element in extents_by_end. */
+    struct list_elem size_elem;         /* Element in a size_classes list. */
+  };
+
+/* Number of size classes.  Class I holds extents of 2**I to
+   2**(I+1) - 1 sectors. */
+#define SIZE_CLASS_CNT 32
+
+static struct hash extents_by_start;    /* Keyed on START. */
+static struct hash extents_by_end;      /* Keyed on START + CNT. */
+static struct list size_classes[SIZE_CLASS_CNT];
+
+static hash_hash_func extent_start_hash, extent_end_hash;
+static hash_less_func extent_start_less, extent_end_less;
+static void free_map_insert_free (block_sector_t, size_t);
+
+/* Returns the size class for an extent of CNT sectors. */
+static size_t
+size_class (size_t cnt)
+{
+  ASSERT (cnt > 0);
+  return 31 - __builtin_clz (cnt);
+}
+
+/* Adds a free extent of CNT sectors starting at START to the
+   index.  Panics if memory is exhausted, since free space would
+   otherwise be lost. */
+static void
+extent_insert (block_sector_t start, size_t cnt)
+{
+  struct extent *x = malloc (sizeof *x);
+  if (x == NULL)
+    PANIC ("free map: out of memory for free extents");
+  x->start = start;
+  x->cnt = cnt;
+  hash_insert (&extents_by_start, &x->start_elem);
+  hash_insert (&extents_by_end, &x->end_elem);
+  list_push_front (&size_classes[size_class (cnt)], &x->size_elem);
+}
+
+/* Removes extent X from the index and frees it. */
+static void
+extent_delete (struct extent *x)
+{
+  hash_delete (&extents_by_start, &x->start_elem);
+  hash_delete (&extents_by_end, &x->end_elem);
+  list_remove (&x->size_elem);
+  free (x);
+}
+
+/* Returns the free extent that starts at SECTOR, or a null
+   pointer if there is none. */
+static struct extent *
+extent_starting_at (block_sector_t sector)
+{
+  struct extent key;
+  struct hash_elem *e;
+
+  key.start = sector;
+  e = hash_find (&extents_by_start, &key.start_elem);
+  return e != NULL ? hash_entry (e, struct extent, start_elem) : NULL;
+}
+
+/* Returns the free extent that ends just before SECTOR, or a
+   null pointer if there is none. */
+static struct extent *
+extent_ending_at (block_sector_t sector)
+{
+  struct extent key;
+  struct hash_elem *e;
+
+  key.start = sector;
+  key.cnt = 0;
+  e = hash_find (&extents_by_end, &key.end_elem);
+  return e != NULL ? hash_entry (e, struct extent, end_elem) : NULL;
+}
+
+/* Returns the smallest free extent of at least CNT sectors within
+   CNT's size class, or failing that the first extent in the
+   smallest larger class that is not empty.  Returns a null
+   pointer if no extent is large enough. */
+static struct extent *
+extent_best_fit (size_t cnt)
+{
+  struct extent *best = NULL;
+  struct list_elem *e;
+  size_t class;
+
+  class = size_class (cnt);
+  for (e = list_begin (&size_classes[class]);
+       e != list_end (&size_classes[class]); e = list_next (e))
+    {
+      struct extent *x = list_entry (e, struct extent, size_elem);
+      if (x->cnt >= cnt && (best == NULL || x->cnt < best->cnt))
+        {
+          best = x;
+          if (x->cnt == cnt)
+            break;
+        }
+    }
+
+  for (class++; best == NULL && class < SIZE_CLASS_CNT; class++)
+    if (!list_empty (&size_classes[class]))
+      best = list_entry (list_front (&size_classes[class]),
+                         struct extent, size_elem);
+  return best;
+}
+
+/* Removes the first CNT sectors from free extent X, which must
+   have at least that many, and returns the first of them. */
+static block_sector_t
+extent_carve (struct extent *x, size_t cnt)
+{
+  block_sector_t start = x->start;
+  size_t left = x->cnt - cnt;
+
+  ASSERT (x->cnt >= cnt);
+  extent_delete (x);
+  if (left > 0)
+    extent_insert (start + cnt, left);
+  return start;
+}
+
+/* Rebuilds the free extent index from the free map. */
+static void
+extents_build (void)
+{
+  size_t size = bitmap_size (free_map);
+  size_t start = 0;
+
+  while (start < size)
+    {
+      size_t end;
+
+      start = bitmap_scan (free_map, start, 1, false);
+      if (start == BITMAP_ERROR)
+        break;
+      end = bitmap_scan (free_map, start, 1, true);
+      if (end == BITMAP_ERROR)
+        end = size;
+      extent_insert (start, end - start);
+      start = end;
+    }
+}
 
 /* Initializes the free map. */
 void
 free_map_init (void) 
 {
+  size_t i;
+
   free_map = bitmap_create (block_size (fs_device));
   if (free_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  lock_init (&free_map_lock);
+
+  dirty_sectors = bitmap_create (DIV_ROUND_UP (bitmap_file_size (free_map),
+                                               BLOCK_SECTOR_SIZE));
+  if (dirty_sectors == NULL)
+    PANIC ("free map: dirty sector map creation failed");
+  list_init (&pending_releases);
+
+  if (!hash_init (&extents_by_start, extent_start_hash, extent_start_less,
+                  NULL)
+      || !hash_init (&extents_by_end, extent_end_hash, extent_end_less, NULL))
+    PANIC ("free map: hash table creation failed");
+  for (i = 0; i < SIZE_CLASS_CNT; i++)
+    list_init (&size_classes[i]);
+  extents_build ();
+}
+
+/* Notes that the free map bits for the CNT sectors starting at
+   SECTOR have changed.  Caller must hold free_map_lock. */
+static void
+mark_dirty (block_sector_t sector, size_t cnt)
+{
+  size_t first = sector / BITS_PER_SECTOR;
+  size_t last = (sector + cnt - 1) / BITS_PER_SECTOR;
+
+  bitmap_set_multiple (dirty_sectors, first, last - first + 1, true);
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
    the first into *SECTORP.
    Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
+   sectors were available. */
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  return free_map_allocate_near (cnt, 0, sectorp);
+}
+
+/* Allocates CNT consecutive sectors from the free map, starting
+   at HINT if those sectors are free and otherwise wherever they
+   fit best, and stores the first into *SECTORP.  A HINT of 0
+   means no preference.
+   Returns true if successful, false if not enough consecutive
+   sectors were available. */
+bool
+free_map_allocate_near (size_t cnt, block_sector_t hint,
+                        block_sector_t *sectorp)
+{
+  struct extent *x = NULL;
+  block_sector_t sector;
+
+  ASSERT (cnt > 0);
+
+  lock_acquire (&free_map_lock);
+  if (hint != 0)
     {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
+      x = extent_starting_at (hint);
+      if (x != NULL && x->cnt < cnt)
+        x = NULL;
     }
-  if (sector != BITMAP_ERROR)
-    *sectorp = sector;
-  return sector != BITMAP_ERROR;
+  if (x == NULL)
+    x = extent_best_fit (cnt);
+  if (x == NULL && !list_empty (&pending_releases))
+    {
+      /* Space may be waiting to be released.  Take a checkpoint
+         now rather than fail. */
+      lock_release (&free_map_lock);
+      free_map_checkpoint ();
+      lock_acquire (&free_map_lock);
+      x = extent_best_fit (cnt);
+    }
+  if (x == NULL)
+    {
+      lock_release (&free_map_lock);
+      return false;
+    }
+
+  sector = extent_carve (x, cnt);
+  bitmap_set_multiple (free_map, sector, cnt, true);
+  mark_dirty (sector, cnt);
+  lock_release (&free_map_lock);
+
+  *sectorp = sector;
+  return true;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Adds the CNT free sectors starting at SECTOR to the extent
+   index, merging them with adjacent free extents.  Caller must
+   hold free_map_lock. */
+static void
+free_map_insert_free (block_sector_t sector, size_t cnt)
+{
+  struct extent *before = extent_ending_at (sector);
+  struct extent *after = extent_starting_at (sector + cnt);
+
+  if (before != NULL)
+    {
+      sector = before->start;
+      cnt += before->cnt;
+      extent_delete (before);
+    }
+  if (after != NULL)
+    {
+      cnt += after->cnt;
+      extent_delete (after);
+    }
+  extent_insert (sector, cnt);
+}
+
+/* Returns CNT sectors starting at SECTOR to the free map.
+   Caller must hold free_map_lock. */
+static void
+release_now (block_sector_t sector, size_t cnt)
+{
+  bitmap_set_multiple (free_map, sector, cnt, false);
+  free_map_insert_free (sector, cnt);
+  mark_dirty (sector, cnt);
+}
+
+/* Makes CNT sectors starting at SECTOR available for use, once
+   the next checkpoint has written the inodes that referred to
+   them.  While the file system is being formatted, or if memory
+   is short, they are made available at once. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  struct extent *x;
+
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
-  bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  x = free_map_file != NULL ? malloc (sizeof *x) : NULL;
+  if (x != NULL)
+    {
+      x->start = sector;
+      x->cnt = cnt;
+      list_push_back (&pending_releases, &x->size_elem);
+    }
+  else
+    release_now (sector, cnt);
+  lock_release (&free_map_lock);
+}
+
+/* Returns the number of bytes of the free map file held in its
+   sector IDX, and their offset in *OFSP. */
+static size_t
+sector_bytes (size_t idx, size_t *ofsp)
+{
+  size_t file_size = bitmap_file_size (free_map);
+  size_t ofs = idx * BLOCK_SECTOR_SIZE;
+
+  *ofsp = ofs;
+  return file_size - ofs < BLOCK_SECTOR_SIZE ? file_size - ofs
+                                             : BLOCK_SECTOR_SIZE;
 }
 
-/* Opens the free map file and reads it from disk. */
+/* Writes the dirty sectors of the free map file to disk.  Caller
+   must hold free_map_lock. */
+static void
+write_dirty_sectors (void)
+{
+  size_t idx = 0;
+
+  if (map_sectors == NULL)
+    return;
+  while ((idx = bitmap_scan_and_flip (dirty_sectors, idx, 1, true))
+         != BITMAP_ERROR)
+    {
+      size_t ofs;
+      size_t size = sector_bytes (idx, &ofs);
+
+      memset (sector_buf, 0, sizeof sector_buf);
+      bitmap_get_bytes (free_map, ofs, sector_buf, size);
+      block_write (fs_device, map_sectors[idx], sector_buf);
+    }
+}
+
+/* Writes the free map's dirty sectors to disk.  Called by the
+   buffer cache before it writes back metadata.  Never touches the
+   cache, which may be in the middle of an eviction. */
+void
+free_map_sync (void)
+{
+  lock_acquire (&free_map_lock);
+  write_dirty_sectors ();
+  lock_release (&free_map_lock);
+}
+
+/* Writes the free map's dirty sectors and the rest of the buffer
+   cache to disk, then returns the sectors released before the
+   flush began to the free map.  Their bits reach the disk at the
+   following checkpoint.  The flush runs without free_map_lock,
+   so that allocation need not wait for it.  Called periodically
+   by the buffer cache's write-behind thread. */
+void
+free_map_checkpoint (void)
+{
+  struct list released;
+
+  list_init (&released);
+  lock_acquire (&free_map_lock);
+  write_dirty_sectors ();
+  while (!list_empty (&pending_releases))
+    list_push_back (&released, list_pop_front (&pending_releases));
+  lock_release (&free_map_lock);
+
+  cache_flush ();
+
+  lock_acquire (&free_map_lock);
+  while (!list_empty (&released))
+    {
+      struct extent *x = list_entry (list_pop_front (&released),
+                                     struct extent, size_elem);
+      release_now (x->start, x->cnt);
+      free (x);
+    }
+  lock_release (&free_map_lock);
+}
+
+/* Discards the free extent index. */
+static void
+extents_clear (void)
+{
+  size_t i;
+
+  for (i = 0; i < SIZE_CLASS_CNT; i++)
+    while (!list_empty (&size_classes[i]))
+      extent_delete (list_entry (list_front (&size_classes[i]),
+                                 struct extent, size_elem));
+}
+
+/* Looks up where on disk each sector of the free map file lies,
+   so that free_map_sync() can write them without the cache.
+   Panics if the file is not all in written sectors. */
+static void
+map_file (void)
+{
+  struct inode *inode = file_get_inode (free_map_file);
+  size_t cnt = bitmap_size (dirty_sectors);
+  block_sector_t *sectors;
+  size_t i;
+
+  sectors = malloc (cnt * sizeof *sectors);
+  if (sectors == NULL)
+    PANIC ("free map: out of memory for sector map");
+  for (i = 0; i < cnt; i++)
+    {
+      sectors[i] = inode_get_sector (inode, i * BLOCK_SECTOR_SIZE);
+      if (sectors[i] == 0)
+        PANIC ("free map file is not in whole sectors");
+    }
+
+  lock_acquire (&free_map_lock);
+  map_sectors = sectors;
+  lock_release (&free_map_lock);
+}
+
+/* Opens the free map file and reads it from disk.  The buffer
+   cache may hold stale copies of its sectors, so they are read
+   directly. */
 void
 free_map_open (void) 
 {
+  size_t idx;
+
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
-  if (!bitmap_read (free_map, free_map_file))
-    PANIC ("can't read free map");
+  map_file ();
+
+  lock_acquire (&free_map_lock);
+  for (idx = 0; idx < bitmap_size (dirty_sectors); idx++)
+    {
+      size_t ofs;
+      size_t size = sector_bytes (idx, &ofs);
+
+      block_read (fs_device, map_sectors[idx], sector_buf);
+      bitmap_set_bytes (free_map, ofs, sector_buf, size);
+    }
+  bitmap_set_all (dirty_sectors, false);
+  extents_clear ();
+  extents_build ();
+  lock_release (&free_map_lock);
 }
 
-/* Writes the free map to disk and closes the free map file. */
+/* Writes the free map to disk and closes the free map file.
+   Nothing can be written if we got here through a kernel panic,
+   because the disk driver needs interrupts turned on. */
 void
 free_map_close (void) 
 {
+  if (intr_get_level () == INTR_ON)
+    free_map_checkpoint ();
+  lock_acquire (&free_map_lock);
+  if (intr_get_level () == INTR_ON)
+    write_dirty_sectors ();
   file_close (free_map_file);
+  free_map_file = NULL;
+  free (map_sectors);
+  map_sectors = NULL;
+  lock_release (&free_map_lock);
 }
 
 /* Creates a new free map file on disk and writes the free map to
-   it. */
+   it.  The file is a whole number of sectors long, so that it is
+   never stored inline, and is written once through the buffer
+   cache, which marks its sectors written, and flushed.  After
+   that, free_map_sync() writes it directly. */
 void
 free_map_create (void) 
 {
+  size_t size = bitmap_file_size (free_map);
+
   /* Create inode. */
-  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
+  if (!inode_create (FREE_MAP_SECTOR, ROUND_UP (size, BLOCK_SECTOR_SIZE),
+                     false))
     PANIC ("free map creation failed");
 
   /* Write bitmap to file. */
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
+  lock_acquire (&free_map_lock);
+  bitmap_set_all (dirty_sectors, false);
+  lock_release (&free_map_lock);
   if (!bitmap_write (free_map, free_map_file))
     PANIC ("can't write free map");
+  cache_flush ();
+  map_file ();
+}
+
+/* Returns a hash value for extent X's start. */
+static unsigned
+extent_start_hash (const struct hash_elem *x_, void *aux UNUSED)
+{
+  const struct extent *x = hash_entry (x_, struct extent, start_elem);
+  return hash_int (x->start);
+}
+
+/* Returns true if extent A starts before extent B. */
+static bool
+extent_start_less (const struct hash_elem *a_, const struct hash_elem *b_,
+                   void *aux UNUSED)
+{
+  const struct extent *a = hash_entry (a_, struct extent, start_elem);
+  const struct extent *b = hash_entry (b_, struct extent, start_elem);
+  return a->start < b->start;
+}
+
+/* Returns a hash value for extent X's end. */
+static unsigned
+extent_end_hash (const struct hash_elem *x_, void *aux UNUSED)
+{
+  const struct extent *x = hash_entry (x_, struct extent, end_elem);
+  return hash_int (x->start + x->cnt);
+}
+
+/* Returns true if extent A ends before extent B. */
+static bool
+extent_end_less (const struct hash_elem *a_, const struct hash_elem *b_,
+                 void *aux UNUSED)
+{
+  const struct extent *a = hash_entry (a_, struct extent, end_elem);
+  const struct extent *b = hash_entry (b_, struct extent, end_elem);
+  return a->start + a->cnt < b->start + b->cnt;
 }
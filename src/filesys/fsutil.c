@@ -1,5 +1,6 @@
 #include "filesys/fsutil.h"
 #include <debug.h>
+#include <round.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,6 +12,10 @@
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
 
+/* Sectors moved between a file and the scratch device by each
+   block_read_multiple() or block_write_multiple(). */
+#define CHUNK_SECTORS 16
+
 /* List files in the root directory. */
 void
 fsutil_ls (char **argv UNUSED) 
@@ -78,7 +83,7 @@ fsutil_extract (char **argv UNUSED)
 
   /* Allocate buffers. */
   header = malloc (BLOCK_SECTOR_SIZE);
-  data = malloc (BLOCK_SECTOR_SIZE);
+  data = malloc (CHUNK_SECTORS * BLOCK_SECTOR_SIZE);
   if (header == NULL || data == NULL)
     PANIC ("couldn't allocate buffers");
 
@@ -126,10 +131,13 @@ fsutil_extract (char **argv UNUSED)
           /* Do copy. */
           while (size > 0)
             {
-              int chunk_size = (size > BLOCK_SECTOR_SIZE
-                                ? BLOCK_SECTOR_SIZE
+              int chunk_size = (size > CHUNK_SECTORS * BLOCK_SECTOR_SIZE
+                                ? CHUNK_SECTORS * BLOCK_SECTOR_SIZE
                                 : size);
-              block_read (src, sector++, data);
+              block_sector_t chunk_sectors = DIV_ROUND_UP (chunk_size,
+                                                           BLOCK_SECTOR_SIZE);
+              block_read_multiple (src, sector, chunk_sectors, data);
+              sector += chunk_sectors;
               if (file_write (dst, data, chunk_size) != chunk_size)
                 PANIC ("%s: write failed with %d bytes unwritten",
                        file_name, size);
@@ -176,7 +184,7 @@ fsutil_append (char **argv)
   printf ("Appending '%s' to ustar archive on scratch device...\n", file_name);
 
   /* Allocate buffer. */
-  buffer = malloc (BLOCK_SECTOR_SIZE);
+  buffer = malloc (CHUNK_SECTORS * BLOCK_SECTOR_SIZE);
   if (buffer == NULL)
     PANIC ("couldn't allocate buffer");
 
@@ -199,13 +207,19 @@ fsutil_append (char **argv)
   /* Do copy. */
   while (size > 0) 
     {
-      int chunk_size = size > BLOCK_SECTOR_SIZE ? BLOCK_SECTOR_SIZE : size;
-      if (sector >= block_size (dst))
+      int chunk_size = (size > CHUNK_SECTORS * BLOCK_SECTOR_SIZE
+                        ? CHUNK_SECTORS * BLOCK_SECTOR_SIZE
+                        : size);
+      block_sector_t chunk_sectors = DIV_ROUND_UP (chunk_size,
+                                                   BLOCK_SECTOR_SIZE);
+      if (chunk_sectors > block_size (dst) - sector)
         PANIC ("%s: out of space on scratch device", file_name);
       if (file_read (src, buffer, chunk_size) != chunk_size)
         PANIC ("%s: read failed with %"PROTd" bytes unread", file_name, size);
-      memset (buffer + chunk_size, 0, BLOCK_SECTOR_SIZE - chunk_size);
-      block_write (dst, sector++, buffer);
+      memset (buffer + chunk_size, 0,
+              chunk_sectors * BLOCK_SECTOR_SIZE - chunk_size);
+      block_write_multiple (dst, sector, chunk_sectors, buffer);
+      sector += chunk_sectors;
       size -= chunk_size;
     }
 
@@ -1,79 +1,369 @@
 #include "filesys/inode.h"
-#include <list.h>
+#include <hash.h>
 #include <debug.h>
+#include <stdio.h>
 #include <round.h>
+#include <stddef.h>
 #include <string.h>
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Inode flags. */
+#define INODE_DIR 0x1                   /* Inode is a directory. */
+#define INODE_INLINE 0x2                /* Data is stored in the inode. */
+
+/* Block index.
+   An inode's data sectors are found through BLOCK_CNT pointers in
+   the inode: DIRECT_CNT pointers to data sectors, then one to an
+   indirect block of PTRS_PER_SECTOR pointers to data sectors, then
+   one to a doubly indirect block of pointers to indirect blocks.
+   A null pointer (sector 0, which holds the free map inode and so
+   is never a data sector) is a hole that reads as zeros.
+
+   A pointer to a data sector with PTR_UNWRITTEN set refers to a
+   sector that has been allocated but never written.  It also
+   reads as zeros, without touching the disk, so preallocating a
+   file writes only its index.  The first write to such a sector
+   fills it with zeros in the buffer cache, instead of reading
+   it, and clears the bit. */
+#define DIRECT_CNT 123
+#define INDIRECT_IDX DIRECT_CNT
+#define DBL_INDIRECT_IDX (DIRECT_CNT + 1)
+#define BLOCK_CNT (DIRECT_CNT + 2)
+#define PTR_UNWRITTEN 0x80000000u
+#define PTRS_PER_SECTOR ((off_t) (BLOCK_SECTOR_SIZE / sizeof (block_sector_t)))
+
+/* Inline data.
+   A file of at most INLINE_MAX bytes keeps its data in the inode
+   sector itself, in place of the block index, so that reading it
+   takes one sector instead of two.  Bytes past the end of the
+   data are always zero.  The first write that would make the file
+   any longer moves the data out to a data block. */
+#define INLINE_MAX ((off_t) (BLOCK_CNT * sizeof (block_sector_t)))
+
+/* Maximum length of an inode, in bytes. */
+#define INODE_SPAN ((DIRECT_CNT                                       \
+                     + PTRS_PER_SECTOR                                \
+                     + PTRS_PER_SECTOR * PTRS_PER_SECTOR)             \
+                    * BLOCK_SECTOR_SIZE)
+
 /* On-disk inode.
    Must be exactly BLOCK_SECTOR_SIZE bytes long. */
 struct inode_disk
   {
-    block_sector_t start;               /* First data sector. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
+    union
+      {
+        block_sector_t blocks[BLOCK_CNT];   /* Block index. */
+        uint8_t inline_data[INLINE_MAX];    /* Data, if INODE_INLINE. */
+      };
+    uint32_t flags;                     /* INODE_* flags. */
   };
 
-/* Returns the number of sectors to allocate for an inode SIZE
-   bytes long. */
-static inline size_t
-bytes_to_sectors (off_t size)
-{
-  return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
-}
+/* In-memory inode.
 
-/* In-memory inode. */
+   Reads, and writes that stay within the file, hold RWLOCK for
+   reading, so that they proceed in parallel; the buffer cache
+   makes each sector copy atomic.  Writes that extend the file, and
+   changes to DENY_WRITE_CNT, hold it for writing, so that no one
+   sees part of an extension.  GROW_LOCK is still needed to fill
+   holes, which shared writers may do.  DIR_LOCK serializes changes
+   to a directory's entries. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
-    block_sector_t sector;              /* Sector number of disk location. */
+    /* Protected by open_inodes_lock. */
+    struct hash_elem elem;              /* Element in open_inodes. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
+
+    block_sector_t sector;              /* Sector number of disk location. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    off_t read_ahead_pos;               /* Offset a sequential read would
+                                           start at. */
+    struct rwlock rwlock;               /* Shared by readers and in-place
+                                           writers. */
+    struct lock grow_lock;              /* Serializes block allocation and
+                                           length changes. */
+    struct lock dir_lock;               /* Serializes directory updates. */
     struct inode_disk data;             /* Inode content. */
   };
 
-/* Returns the block device sector that contains byte offset POS
-   within INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+static struct inode *find_open_inode (block_sector_t);
+
+/* A sector's worth of zeros, for initializing new sectors. */
+static char zeros[BLOCK_SECTOR_SIZE];
+
+/* Returns true if INODE's data is stored inline. */
+static inline bool
+is_inline (const struct inode *inode)
+{
+  return (inode->data.flags & INODE_INLINE) != 0;
+}
+
+/* Allocates a sector, preferably *HINTP, and stores a pointer to
+   it in *PTRP.  A DATA sector is left unwritten; an index sector
+   is zeroed.  Advances *HINTP past the new sector, so that
+   sectors allocated one after another end up adjacent on disk.
+   Returns true if successful, false if the disk is full. */
+static bool
+allocate_block (block_sector_t *ptrp, block_sector_t *hintp, bool data)
+{
+  block_sector_t sector;
+
+  if (!free_map_allocate_near (1, *hintp, &sector))
+    return false;
+  if (data)
+    *ptrp = sector | PTR_UNWRITTEN;
+  else
+    {
+      cache_write (sector, zeros);
+      *ptrp = sector;
+    }
+  *hintp = sector + 1;
+  return true;
+}
+
+/* Returns pointer IDX within INODE itself.  If it is a hole and
+   HINTP is non-null, first fills it with a newly allocated
+   sector, placed near *HINTP, that is a DATA sector or an index
+   sector.  Returns 0 for a hole or if allocation fails. */
+static block_sector_t
+get_inode_ptr (struct inode *inode, size_t idx, block_sector_t *hintp,
+               bool data)
+{
+  block_sector_t *ptr = &inode->data.blocks[idx];
+
+  if (*ptr == 0 && hintp != NULL && allocate_block (ptr, hintp, data))
+    cache_write (inode->sector, &inode->data);
+  return *ptr;
+}
+
+/* Returns pointer IDX within index block SECTOR.  If it is a hole
+   and HINTP is non-null, first fills it with a newly allocated
+   sector, placed near *HINTP, that is a DATA sector or an index
+   sector.  Returns 0 for a hole or if allocation fails. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+get_index_ptr (block_sector_t sector, size_t idx, block_sector_t *hintp,
+               bool data)
 {
+  block_sector_t ptr;
+  off_t ofs = idx * sizeof ptr;
+
+  if (sector == 0)
+    return 0;
+  cache_read_at (sector, &ptr, sizeof ptr, ofs);
+  if (ptr == 0 && hintp != NULL && allocate_block (&ptr, hintp, data))
+    cache_write_at (sector, &ptr, sizeof ptr, ofs);
+  return ptr;
+}
+
+/* Returns the pointer to the block device sector that contains
+   byte offset POS within INODE, which may have PTR_UNWRITTEN
+   set, or 0 if that part of INODE is a hole.  If
+   ALLOCATE is true, the caller must hold INODE's grow_lock, and
+   holes along the way are filled with new sectors, placed
+   right after the sector holding the previous block if possible;
+   0 is then returned only if the disk is full.  Once the index
+   blocks are cached, a lookup reads nothing from disk. */
+static block_sector_t
+byte_to_sector (struct inode *inode, off_t pos, bool allocate) 
+{
+  block_sector_t hint = 0;
+  block_sector_t *hintp = NULL;
+  off_t idx;
+
   ASSERT (inode != NULL);
-  if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
+  ASSERT (pos >= 0 && pos < INODE_SPAN);
+  ASSERT (!allocate || lock_held_by_current_thread (&inode->grow_lock));
+
+  if (allocate)
+    {
+      if (pos >= BLOCK_SECTOR_SIZE)
+        hint = byte_to_sector (inode, pos - BLOCK_SECTOR_SIZE, false);
+      hint = hint != 0 ? (hint & ~PTR_UNWRITTEN) + 1 : inode->sector + 1;
+      hintp = &hint;
+    }
+
+  idx = pos / BLOCK_SECTOR_SIZE;
+  if (idx < DIRECT_CNT)
+    return get_inode_ptr (inode, idx, hintp, true);
+
+  idx -= DIRECT_CNT;
+  if (idx < PTRS_PER_SECTOR)
+    return get_index_ptr (get_inode_ptr (inode, INDIRECT_IDX, hintp, false),
+                          idx, hintp, true);
+
+  idx -= PTRS_PER_SECTOR;
+  return get_index_ptr (get_index_ptr (get_inode_ptr (inode, DBL_INDIRECT_IDX,
+                                                      hintp, false),
+                                       idx / PTRS_PER_SECTOR, hintp, false),
+                        idx % PTRS_PER_SECTOR, hintp, true);
+}
+
+/* Returns the sector that contains byte offset POS within INODE,
+   allocating it and any index blocks needed to reach it if it is
+   a hole.  Returns 0 if the disk is full. */
+static block_sector_t
+byte_to_sector_alloc (struct inode *inode, off_t pos)
+{
+  block_sector_t sector = byte_to_sector (inode, pos, false);
+
+  if (sector == 0)
+    {
+      lock_acquire (&inode->grow_lock);
+      sector = byte_to_sector (inode, pos, true);
+      lock_release (&inode->grow_lock);
+    }
+  return sector;
+}
+
+/* Clears PTR_UNWRITTEN in the pointer to the data sector that
+   holds byte offset POS within INODE.  Caller must hold INODE's
+   grow_lock. */
+static void
+mark_written (struct inode *inode, off_t pos)
+{
+  off_t idx = pos / BLOCK_SECTOR_SIZE;
+  block_sector_t index, ptr;
+  off_t ofs;
+
+  ASSERT (lock_held_by_current_thread (&inode->grow_lock));
+
+  if (idx < DIRECT_CNT)
+    {
+      inode->data.blocks[idx] &= ~PTR_UNWRITTEN;
+      cache_write (inode->sector, &inode->data);
+      return;
+    }
+
+  idx -= DIRECT_CNT;
+  if (idx < PTRS_PER_SECTOR)
+    index = inode->data.blocks[INDIRECT_IDX];
   else
-    return -1;
+    {
+      idx -= PTRS_PER_SECTOR;
+      index = get_index_ptr (inode->data.blocks[DBL_INDIRECT_IDX],
+                             idx / PTRS_PER_SECTOR, NULL, false);
+      idx %= PTRS_PER_SECTOR;
+    }
+  ofs = idx * sizeof ptr;
+  cache_read_at (index, &ptr, sizeof ptr, ofs);
+  ptr &= ~PTR_UNWRITTEN;
+  cache_write_at (index, &ptr, sizeof ptr, ofs);
+}
+
+/* Gives the data sector that holds byte offset POS within INODE,
+   which was unwritten when last looked up, its initial contents
+   of zeros in the buffer cache, without reading it from disk,
+   unless another writer has already done so, and returns it. */
+static block_sector_t
+fill_unwritten (struct inode *inode, off_t pos)
+{
+  block_sector_t sector;
+
+  lock_acquire (&inode->grow_lock);
+  sector = byte_to_sector (inode, pos, false);
+  if (sector & PTR_UNWRITTEN)
+    {
+      sector &= ~PTR_UNWRITTEN;
+      cache_write_data (sector, zeros);
+      mark_written (inode, pos);
+    }
+  lock_release (&inode->grow_lock);
+  return sector;
+}
+
+/* Frees SECTOR and, if it is an index block with LEVELS levels of
+   pointers below it, every sector it points to. */
+static void
+release_tree (block_sector_t sector, int levels)
+{
+  sector &= ~PTR_UNWRITTEN;
+  if (sector == 0)
+    return;
+  if (levels > 0)
+    {
+      block_sector_t *ptrs = malloc (BLOCK_SECTOR_SIZE);
+      off_t i;
+
+      if (ptrs != NULL)
+        {
+          cache_read (sector, ptrs);
+          for (i = 0; i < PTRS_PER_SECTOR; i++)
+            release_tree (ptrs[i], levels - 1);
+          free (ptrs);
+        }
+    }
+  free_map_release (sector, 1);
+}
+
+/* Frees all of INODE's data and index sectors. */
+static void
+release_blocks (struct inode *inode)
+{
+  size_t i;
+
+  if (is_inline (inode))
+    return;
+  for (i = 0; i < DIRECT_CNT; i++)
+    release_tree (inode->data.blocks[i], 0);
+  release_tree (inode->data.blocks[INDIRECT_IDX], 1);
+  release_tree (inode->data.blocks[DBL_INDIRECT_IDX], 2);
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Open inodes, keyed by sector, so that opening a single inode
+   twice returns the same `struct inode'. */
+static struct hash open_inodes;
+static struct lock open_inodes_lock;    /* Protects open_inodes. */
+
+/* Number of inode_open() calls that found the inode already
+   open, and that had to read it.  Protected by
+   open_inodes_lock. */
+static unsigned long long open_hit_cnt, open_miss_cnt;
+
+static hash_hash_func inode_hash;
+static hash_less_func inode_less;
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  if (!hash_init (&open_inodes, inode_hash, inode_less, NULL))
+    PANIC ("inode: hash table creation failed");
+  lock_init (&open_inodes_lock);
+}
+
+/* Prints statistics on the open inode table. */
+void
+inode_print_stats (void)
+{
+  printf ("Open inodes: %llu hits, %llu misses\n",
+          open_hit_cnt, open_miss_cnt);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
    writes the new inode to sector SECTOR on the file system
-   device.
+   device.  The inode is a directory if IS_DIR is true, otherwise
+   an ordinary file.  Data that fits is stored inline.  Otherwise
+   the data sectors are allocated right away, so that the file
+   can later be written without allocating, but left unwritten,
+   so that only the index reaches the disk.
    Returns true if successful.
    Returns false if memory or disk allocation fails. */
 bool
-inode_create (block_sector_t sector, off_t length)
+inode_create (block_sector_t sector, off_t length, bool is_dir)
 {
   struct inode_disk *disk_inode = NULL;
-  bool success = false;
+  struct inode *inode;
+  bool success = true;
+  off_t pos;
 
   ASSERT (length >= 0);
 
@@ -81,27 +371,42 @@ inode_create (block_sector_t sector, off_t length)
      one sector in size, and you should fix that. */
   ASSERT (sizeof *disk_inode == BLOCK_SECTOR_SIZE);
 
+  if (length > INODE_SPAN)
+    return false;
+
   disk_inode = calloc (1, sizeof *disk_inode);
-  if (disk_inode != NULL)
+  if (disk_inode == NULL)
+    return false;
+  disk_inode->length = 0;
+  disk_inode->magic = INODE_MAGIC;
+  disk_inode->flags = is_dir ? INODE_DIR : 0;
+  if (length <= INLINE_MAX)
     {
-      size_t sectors = bytes_to_sectors (length);
       disk_inode->length = length;
-      disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
-        {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
-            }
-          success = true; 
-        } 
-      free (disk_inode);
+      disk_inode->flags |= INODE_INLINE;
+    }
+  cache_write (sector, disk_inode);
+  free (disk_inode);
+  if (length <= INLINE_MAX)
+    return true;
+
+  inode = inode_open (sector);
+  if (inode == NULL)
+    return false;
+
+  lock_acquire (&inode->grow_lock);
+  for (pos = 0; pos < length && success; pos += BLOCK_SECTOR_SIZE)
+    success = byte_to_sector (inode, pos, true) != 0;
+  if (success)
+    {
+      inode->data.length = length;
+      cache_write (inode->sector, &inode->data);
     }
+  else
+    release_blocks (inode);
+  lock_release (&inode->grow_lock);
+
+  inode_close (inode);
   return success;
 }
 
@@ -111,42 +416,81 @@ inode_create (block_sector_t sector, off_t length)
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
-  struct inode *inode;
+  struct inode *inode, *new;
 
   /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
-    {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
-        {
-          inode_reopen (inode);
-          return inode; 
-        }
-    }
+  lock_acquire (&open_inodes_lock);
+  inode = find_open_inode (sector);
+  if (inode != NULL)
+    open_hit_cnt++;
+  else
+    open_miss_cnt++;
+  lock_release (&open_inodes_lock);
+  if (inode != NULL)
+    return inode;
 
   /* Allocate memory. */
-  inode = malloc (sizeof *inode);
-  if (inode == NULL)
+  new = malloc (sizeof *new);
+  if (new == NULL)
     return NULL;
 
-  /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
-  inode->sector = sector;
-  inode->open_cnt = 1;
-  inode->deny_write_cnt = 0;
-  inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  /* Initialize, reading the disk inode without holding
+     open_inodes_lock. */
+  new->sector = sector;
+  new->open_cnt = 1;
+  new->deny_write_cnt = 0;
+  new->removed = false;
+  new->read_ahead_pos = 0;
+  rwlock_init (&new->rwlock);
+  lock_init (&new->grow_lock);
+  lock_init (&new->dir_lock);
+  cache_read (new->sector, &new->data);
+
+  /* Someone else may have opened it meanwhile. */
+  lock_acquire (&open_inodes_lock);
+  inode = find_open_inode (sector);
+  if (inode == NULL)
+    {
+      hash_insert (&open_inodes, &new->elem);
+      inode = new;
+      new = NULL;
+    }
+  lock_release (&open_inodes_lock);
+  free (new);
   return inode;
 }
 
+/* Returns the open inode for SECTOR with another opener added,
+   or a null pointer if SECTOR is not open.  Caller must hold
+   open_inodes_lock. */
+static struct inode *
+find_open_inode (block_sector_t sector)
+{
+  struct inode key;
+  struct hash_elem *e;
+
+  key.sector = sector;
+  e = hash_find (&open_inodes, &key.elem);
+  if (e == NULL)
+    return NULL;
+  else
+    {
+      struct inode *inode = hash_entry (e, struct inode, elem);
+      inode->open_cnt++;
+      return inode;
+    }
+}
+
 /* Reopens and returns INODE. */
 struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
   return inode;
 }
 
@@ -157,57 +501,119 @@ inode_get_inumber (const struct inode *inode)
   return inode->sector;
 }
 
+/* Returns true if INODE is a directory, false otherwise. */
+bool
+inode_is_dir (const struct inode *inode)
+{
+  return (inode->data.flags & INODE_DIR) != 0;
+}
+
+/* Returns true if INODE has been removed, false otherwise. */
+bool
+inode_is_removed (const struct inode *inode)
+{
+  return inode->removed;
+}
+
 /* Closes INODE and writes it to disk.
    If this was the last reference to INODE, frees its memory.
    If INODE was also a removed inode, frees its blocks. */
 void
 inode_close (struct inode *inode) 
 {
+  bool last;
+
   /* Ignore null pointer. */
   if (inode == NULL)
     return;
 
   /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  lock_acquire (&open_inodes_lock);
+  last = --inode->open_cnt == 0;
+  if (last)
+    hash_delete (&open_inodes, &inode->elem);
+  lock_release (&open_inodes_lock);
+
+  if (last)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
       /* Deallocate blocks if removed. */
       if (inode->removed) 
         {
           free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          release_blocks (inode);
         }
 
       free (inode); 
     }
 }
 
+/* Frees inode SECTOR, which must not be open, and all of its
+   data and index sectors.  Undoes an inode_create() whose inode
+   could not then be opened. */
+void
+inode_release (block_sector_t sector)
+{
+  uint32_t flags;
+  size_t i;
+
+  cache_read_at (sector, &flags, sizeof flags,
+                 offsetof (struct inode_disk, flags));
+  if ((flags & INODE_INLINE) == 0)
+    for (i = 0; i < BLOCK_CNT; i++)
+      {
+        block_sector_t ptr;
+
+        cache_read_at (sector, &ptr, sizeof ptr,
+                       offsetof (struct inode_disk, blocks) + i * sizeof ptr);
+        release_tree (ptr, (i < DIRECT_CNT ? 0
+                            : i == INDIRECT_IDX ? 1 : 2));
+      }
+  free_map_release (sector, 1);
+}
+
 /* Marks INODE to be deleted when it is closed by the last caller who
    has it open. */
 void
 inode_remove (struct inode *inode) 
 {
   ASSERT (inode != NULL);
+  lock_acquire (&open_inodes_lock);
   inode->removed = true;
+  lock_release (&open_inodes_lock);
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
    Returns the number of bytes actually read, which may be less
-   than SIZE if an error occurs or end of file is reached. */
+   than SIZE if an error occurs or end of file is reached.
+   If the read continues where the previous one left off, the
+   sectors following it are read ahead in the background, as many
+   as lie next to each other on disk, up to CACHE_READ_AHEAD_MAX. */
 off_t
 inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
+  bool sequential = offset == inode->read_ahead_pos;
+
+  rwlock_acquire_read (&inode->rwlock);
+  if (is_inline (inode))
+    {
+      off_t inode_left = inode_length (inode) - offset;
+      if (size > inode_left)
+        size = inode_left;
+      if (size > 0)
+        {
+          memcpy (buffer, inode->data.inline_data + offset, size);
+          bytes_read = size;
+        }
+      rwlock_release_read (&inode->rwlock);
+      return bytes_read;
+    }
 
   while (size > 0) 
     {
       /* Disk sector to read, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      block_sector_t sector_idx;
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -220,59 +626,143 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
-        }
-      else 
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-        }
+      sector_idx = byte_to_sector (inode, offset, false);
+      if (sector_idx != 0 && !(sector_idx & PTR_UNWRITTEN))
+        cache_read_at (sector_idx, buffer + bytes_read, chunk_size,
+                       sector_ofs);
+      else
+        memset (buffer + bytes_read, 0, chunk_size);
       
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
+
+  inode->read_ahead_pos = offset;
+  if (sequential && bytes_read > 0)
+    {
+      off_t next = ROUND_UP (offset, BLOCK_SECTOR_SIZE);
+      if (next < inode_length (inode))
+        {
+          block_sector_t next_sector = byte_to_sector (inode, next, false);
+          if (next_sector != 0 && !(next_sector & PTR_UNWRITTEN))
+            {
+              block_sector_t cnt = 1;
+              off_t pos;
+
+              for (pos = next + BLOCK_SECTOR_SIZE;
+                   cnt < CACHE_READ_AHEAD_MAX && pos < inode_length (inode);
+                   pos += BLOCK_SECTOR_SIZE, cnt++)
+                if (byte_to_sector (inode, pos, false) != next_sector + cnt)
+                  break;
+              cache_read_ahead (next_sector, cnt);
+            }
+        }
+    }
+  rwlock_release_read (&inode->rwlock);
 
   return bytes_read;
 }
 
+/* Moves INODE's inline data out to a newly allocated data
+   block, leaving an empty block index in its place.  Caller must
+   hold INODE's rwlock for writing.  Returns true if successful,
+   false if memory or disk space runs out, in which case INODE is
+   unchanged. */
+static bool
+inline_to_blocks (struct inode *inode)
+{
+  block_sector_t sector = 0;
+  uint8_t *data;
+  bool success = true;
+
+  data = calloc (1, BLOCK_SECTOR_SIZE);
+  if (data == NULL)
+    return false;
+  memcpy (data, inode->data.inline_data, INLINE_MAX);
+
+  lock_acquire (&inode->grow_lock);
+  if (inode->data.length > 0
+      && !free_map_allocate_near (1, inode->sector + 1, &sector))
+    success = false;
+  else
+    {
+      if (sector != 0 && inode_is_dir (inode))
+        cache_write (sector, data);
+      else if (sector != 0)
+        cache_write_data (sector, data);
+      memset (inode->data.blocks, 0, sizeof inode->data.blocks);
+      inode->data.blocks[0] = sector;
+      inode->data.flags &= ~INODE_INLINE;
+      cache_write (inode->sector, &inode->data);
+    }
+  lock_release (&inode->grow_lock);
+
+  free (data);
+  return success;
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if the disk fills up, the maximum inode size is
+   reached, or an error occurs.  A write past end of file extends
+   the inode; any gap between the old end of file and OFFSET is
+   left as a hole, which reads as zeros. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
+  bool extend;
 
-  if (inode->deny_write_cnt)
+  /* Clip the write to the maximum length before any arithmetic
+     on OFFSET + SIZE, which could otherwise overflow. */
+  ASSERT (offset >= 0);
+  if (size <= 0 || offset >= INODE_SPAN)
     return 0;
+  if (size > INODE_SPAN - offset)
+    size = INODE_SPAN - offset;
+  extend = offset + size > inode_length (inode);
+
+  /* Files only grow, so a write that fits now still fits once the
+     lock is held. */
+  if (extend)
+    rwlock_acquire_write (&inode->rwlock);
+  else
+    rwlock_acquire_read (&inode->rwlock);
+
+  if (inode->deny_write_cnt)
+    goto done;
+
+  /* Inline data that would outgrow the inode moves out first.
+     The write lock is held, since the file is growing. */
+  if (is_inline (inode) && offset > INLINE_MAX - size
+      && !inline_to_blocks (inode))
+    goto done;
+
+  if (is_inline (inode))
+    {
+      lock_acquire (&inode->grow_lock);
+      memcpy (inode->data.inline_data + offset, buffer, size);
+      if (offset + size > inode->data.length)
+        inode->data.length = offset + size;
+      cache_write (inode->sector, &inode->data);
+      lock_release (&inode->grow_lock);
+      bytes_written = size;
+      goto done;
+    }
 
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      block_sector_t sector_idx;
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
+      /* Bytes left before the maximum length, bytes left in
+         sector, lesser of the two. */
+      off_t inode_left = INODE_SPAN - offset;
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
       int min_left = inode_left < sector_left ? inode_left : sector_left;
 
@@ -281,49 +771,214 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
-        }
-      else 
-        {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
-        }
+      sector_idx = byte_to_sector_alloc (inode, offset);
+      if (sector_idx == 0)
+        break;
+      if (sector_idx & PTR_UNWRITTEN)
+        sector_idx = fill_unwritten (inode, offset);
+      if (inode_is_dir (inode))
+        cache_write_at (sector_idx, buffer + bytes_written, chunk_size,
+                        sector_ofs);
+      else
+        cache_write_data_at (sector_idx, buffer + bytes_written,
+                             chunk_size, sector_ofs);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
 
+  /* Extend the file only once the data is in place, so that
+     readers never see the new length before the new bytes. */
+  if (offset > inode->data.length)
+    {
+      lock_acquire (&inode->grow_lock);
+      if (offset > inode->data.length)
+        {
+          inode->data.length = offset;
+          cache_write (inode->sector, &inode->data);
+        }
+      lock_release (&inode->grow_lock);
+    }
+
+ done:
+  if (extend)
+    rwlock_release_write (&inode->rwlock);
+  else
+    rwlock_release_read (&inode->rwlock);
   return bytes_written;
 }
 
+/* Returns the sector that holds byte OFFSET of INODE's data, or
+   0 if there is none because INODE stores its data inline or
+   OFFSET lies in a hole or in a sector never written. */
+block_sector_t
+inode_get_sector (struct inode *inode, off_t offset)
+{
+  block_sector_t sector = 0;
+
+  rwlock_acquire_read (&inode->rwlock);
+  if (!is_inline (inode))
+    sector = byte_to_sector (inode, offset, false);
+  rwlock_release_read (&inode->rwlock);
+
+  return sector & PTR_UNWRITTEN ? 0 : sector;
+}
+
+/* Copies SIZE bytes from SRC at SRC_OFS to DST at DST_OFS through
+   a one-sector kernel buffer.  Returns the number of bytes
+   copied. */
+static off_t
+copy_buffered (struct inode *dst, off_t dst_ofs,
+               struct inode *src, off_t src_ofs, off_t size)
+{
+  uint8_t *buffer;
+  off_t copied = 0;
+
+  buffer = malloc (BLOCK_SECTOR_SIZE);
+  if (buffer == NULL)
+    return 0;
+  while (size > 0)
+    {
+      off_t chunk = size < BLOCK_SECTOR_SIZE ? size : BLOCK_SECTOR_SIZE;
+      off_t n = inode_read_at (src, buffer, chunk, src_ofs + copied);
+      if (n > 0)
+        n = inode_write_at (dst, buffer, n, dst_ofs + copied);
+      copied += n;
+      size -= n;
+      if (n < chunk)
+        break;
+    }
+  free (buffer);
+  return copied;
+}
+
+/* Copies SECTOR_CNT whole sectors from SRC at SRC_OFS to DST at
+   DST_OFS, both sector-aligned, from one cache entry to another
+   without a bounce buffer.  SRC and DST must differ.  Returns the
+   number of bytes copied. */
+static off_t
+copy_sectors (struct inode *dst, off_t dst_ofs,
+              struct inode *src, off_t src_ofs, off_t sector_cnt)
+{
+  off_t copied = 0;
+  off_t i;
+
+  ASSERT (dst != src);
+  ASSERT (src_ofs % BLOCK_SECTOR_SIZE == 0);
+  ASSERT (dst_ofs % BLOCK_SECTOR_SIZE == 0);
+
+  /* Take the two inodes' locks in a fixed order. */
+  if (src->sector < dst->sector)
+    {
+      rwlock_acquire_read (&src->rwlock);
+      rwlock_acquire_write (&dst->rwlock);
+    }
+  else
+    {
+      rwlock_acquire_write (&dst->rwlock);
+      rwlock_acquire_read (&src->rwlock);
+    }
+
+  if (dst->deny_write_cnt || is_inline (src)
+      || (is_inline (dst) && !inline_to_blocks (dst)))
+    goto done;
+
+  lock_acquire (&dst->grow_lock);
+  for (i = 0; i < sector_cnt; i++)
+    {
+      off_t dst_pos = dst_ofs + i * BLOCK_SECTOR_SIZE;
+      off_t src_pos = src_ofs + i * BLOCK_SECTOR_SIZE;
+      block_sector_t from, to;
+
+      if (dst_pos >= INODE_SPAN)
+        break;
+      to = byte_to_sector (dst, dst_pos, true);
+      if (to == 0)
+        break;
+
+      from = byte_to_sector (src, src_pos, false);
+      if (from == 0 || (from & PTR_UNWRITTEN))
+        cache_write_data (to & ~PTR_UNWRITTEN, zeros);
+      else
+        cache_copy (to & ~PTR_UNWRITTEN, from);
+      if (to & PTR_UNWRITTEN)
+        mark_written (dst, dst_pos);
+      copied += BLOCK_SECTOR_SIZE;
+    }
+  if (dst_ofs + copied > dst->data.length)
+    {
+      dst->data.length = dst_ofs + copied;
+      cache_write (dst->sector, &dst->data);
+    }
+  lock_release (&dst->grow_lock);
+
+ done:
+  rwlock_release_read (&src->rwlock);
+  rwlock_release_write (&dst->rwlock);
+  return copied;
+}
+
+/* Copies SIZE bytes from SRC, starting at SRC_OFS, into DST,
+   starting at DST_OFS, stopping early at SRC's end of file or if
+   DST cannot be written or grown.  When the two offsets are
+   equally aligned within a sector, the whole sectors between
+   them are copied from cache entry to cache entry, and only the
+   partial sectors at either end go through a buffer.  Returns
+   the number of bytes copied, or -1 if DST and SRC are the same
+   inode and the two ranges overlap, since copying front to back
+   would then read bytes it had already overwritten. */
+off_t
+inode_copy_at (struct inode *dst, off_t dst_ofs,
+               struct inode *src, off_t src_ofs, off_t size)
+{
+  off_t head, sector_cnt, copied, n;
+
+  if (size > inode_length (src) - src_ofs)
+    size = inode_length (src) - src_ofs;
+  if (size <= 0)
+    return 0;
+  if (dst == src && (int64_t) dst_ofs < (int64_t) src_ofs + size
+      && (int64_t) src_ofs < (int64_t) dst_ofs + size)
+    return -1;
+  if (dst == src || src_ofs % BLOCK_SECTOR_SIZE != dst_ofs % BLOCK_SECTOR_SIZE)
+    return copy_buffered (dst, dst_ofs, src, src_ofs, size);
+
+  /* Partial sector up to the first sector boundary. */
+  head = (BLOCK_SECTOR_SIZE - src_ofs % BLOCK_SECTOR_SIZE) % BLOCK_SECTOR_SIZE;
+  if (head > size)
+    head = size;
+  copied = copy_buffered (dst, dst_ofs, src, src_ofs, head);
+  if (copied < head)
+    return copied;
+
+  /* Whole sectors. */
+  sector_cnt = (size - head) / BLOCK_SECTOR_SIZE;
+  if (sector_cnt > 0)
+    {
+      n = copy_sectors (dst, dst_ofs + copied, src, src_ofs + copied,
+                        sector_cnt);
+      copied += n;
+      if (n < sector_cnt * BLOCK_SECTOR_SIZE)
+        return copied;
+    }
+
+  /* Partial sector at the end. */
+  copied += copy_buffered (dst, dst_ofs + copied, src, src_ofs + copied,
+                           size - copied);
+  return copied;
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
 inode_deny_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rwlock);
   inode->deny_write_cnt++;
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  rwlock_release_write (&inode->rwlock);
 }
 
 /* Re-enables writes to INODE.
@@ -332,9 +987,26 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 {
+  rwlock_acquire_write (&inode->rwlock);
   ASSERT (inode->deny_write_cnt > 0);
   ASSERT (inode->deny_write_cnt <= inode->open_cnt);
   inode->deny_write_cnt--;
+  rwlock_release_write (&inode->rwlock);
+}
+
+/* Acquires INODE's directory lock, which serializes lookups and
+   changes in the directory that INODE holds. */
+void
+inode_lock_dir (struct inode *inode)
+{
+  lock_acquire (&inode->dir_lock);
+}
+
+/* Releases INODE's directory lock. */
+void
+inode_unlock_dir (struct inode *inode)
+{
+  lock_release (&inode->dir_lock);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -343,3 +1015,21 @@ inode_length (const struct inode *inode)
 {
   return inode->data.length;
 }
+
+/* Returns a hash value for inode I's sector. */
+static unsigned
+inode_hash (const struct hash_elem *i_, void *aux UNUSED)
+{
+  const struct inode *i = hash_entry (i_, struct inode, elem);
+  return hash_int (i->sector);
+}
+
+/* Returns true if inode A's sector precedes inode B's. */
+static bool
+inode_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct inode *a = hash_entry (a_, struct inode, elem);
+  const struct inode *b = hash_entry (b_, struct inode, elem);
+  return a->sector < b->sector;
+}
@@ -3,6 +3,7 @@
 #include <limits.h>
 #include <round.h>
 #include <stdio.h>
+#include <string.h>
 #include "threads/malloc.h"
 #ifdef FILESYS
 #include "filesys/file.h"
@@ -359,6 +360,30 @@ bitmap_write (const struct bitmap *b, struct file *file)
   off_t size = byte_cnt (b->bit_cnt);
   return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Copies the SIZE bytes of B's file image that begin at byte
+   offset OFS into BUFFER. */
+void
+bitmap_get_bytes (const struct bitmap *b, size_t ofs, void *buffer,
+                  size_t size)
+{
+  ASSERT (ofs <= byte_cnt (b->bit_cnt));
+  ASSERT (size <= byte_cnt (b->bit_cnt) - ofs);
+  memcpy (buffer, (const uint8_t *) b->bits + ofs, size);
+}
+
+/* Replaces the SIZE bytes of B's file image that begin at byte
+   offset OFS by those in BUFFER. */
+void
+bitmap_set_bytes (struct bitmap *b, size_t ofs, const void *buffer,
+                  size_t size)
+{
+  ASSERT (ofs <= byte_cnt (b->bit_cnt));
+  ASSERT (size <= byte_cnt (b->bit_cnt) - ofs);
+  memcpy ((uint8_t *) b->bits + ofs, buffer, size);
+  if (b->bit_cnt > 0)
+    b->bits[elem_cnt (b->bit_cnt) - 1] &= last_mask (b);
+}
 #endif /* FILESYS */
 
 /* Debugging. */
@@ -43,6 +43,10 @@ struct file;
 size_t bitmap_file_size (const struct bitmap *);
 bool bitmap_read (struct bitmap *, struct file *);
 bool bitmap_write (const struct bitmap *, struct file *);
+void bitmap_get_bytes (const struct bitmap *, size_t ofs, void *,
+                       size_t size);
+void bitmap_set_bytes (struct bitmap *, size_t ofs, const void *,
+                       size_t size);
 #endif
 
 /* Debugging. */
@@ -0,0 +1,46 @@
+/* Copies most of a file into another with copy_file_range(),
+   starting at positions that are equally aligned within a
+   sector, so that the whole sectors in the middle are copied
+   between cache entries.  The destination starts past its end,
+   leaving a hole that must read back as zeros. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SRC_OFS 100
+#define DST_OFS (SRC_OFS + 512)
+
+static char buf[5000];
+static char expected[DST_OFS + sizeof buf - SRC_OFS];
+
+void
+test_main (void) 
+{
+  int src_fd, dst_fd;
+
+  random_bytes (buf, sizeof buf);
+  CHECK (create ("src", 0), "create \"src\"");
+  CHECK (create ("dst", 0), "create \"dst\"");
+  CHECK ((src_fd = open ("src")) > 1, "open \"src\"");
+  CHECK ((dst_fd = open ("dst")) > 1, "open \"dst\"");
+  CHECK (write (src_fd, buf, sizeof buf) == sizeof buf, "write \"src\"");
+
+  msg ("seek \"src\" to %d and \"dst\" to %d", SRC_OFS, DST_OFS);
+  seek (src_fd, SRC_OFS);
+  seek (dst_fd, DST_OFS);
+  CHECK (copy_file_range (src_fd, dst_fd, sizeof buf) == sizeof buf - SRC_OFS,
+         "copy \"src\" to \"dst\"");
+  CHECK (tell (src_fd) == sizeof buf, "\"src\" position at end of file");
+  CHECK (tell (dst_fd) == sizeof expected, "\"dst\" position at end of file");
+  msg ("close \"src\"");
+  close (src_fd);
+  msg ("close \"dst\"");
+  close (dst_fd);
+
+  memcpy (expected + DST_OFS, buf + SRC_OFS, sizeof buf - SRC_OFS);
+  check_file ("dst", expected, sizeof expected);
+  check_file ("src", buf, sizeof buf);
+}
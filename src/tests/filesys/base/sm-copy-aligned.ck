@@ -0,0 +1,26 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sm-copy-aligned) begin
+(sm-copy-aligned) create "src"
+(sm-copy-aligned) create "dst"
+(sm-copy-aligned) open "src"
+(sm-copy-aligned) open "dst"
+(sm-copy-aligned) write "src"
+(sm-copy-aligned) seek "src" to 100 and "dst" to 612
+(sm-copy-aligned) copy "src" to "dst"
+(sm-copy-aligned) "src" position at end of file
+(sm-copy-aligned) "dst" position at end of file
+(sm-copy-aligned) close "src"
+(sm-copy-aligned) close "dst"
+(sm-copy-aligned) open "dst" for verification
+(sm-copy-aligned) verified contents of "dst"
+(sm-copy-aligned) close "dst"
+(sm-copy-aligned) open "src" for verification
+(sm-copy-aligned) verified contents of "src"
+(sm-copy-aligned) close "src"
+(sm-copy-aligned) end
+EOF
+pass;
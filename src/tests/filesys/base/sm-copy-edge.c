@@ -0,0 +1,47 @@
+/* Tries copy_file_range() at the edges: a copy that runs into
+   the end of the source must stop there, copies from end of file
+   or of zero bytes must copy nothing, and bad file descriptors
+   must fail with -1. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[300];
+
+void
+test_main (void) 
+{
+  int src_fd, dst_fd;
+
+  random_bytes (buf, sizeof buf);
+  CHECK (create ("src", 0), "create \"src\"");
+  CHECK (create ("dst", 0), "create \"dst\"");
+  CHECK ((src_fd = open ("src")) > 1, "open \"src\"");
+  CHECK ((dst_fd = open ("dst")) > 1, "open \"dst\"");
+  CHECK (write (src_fd, buf, sizeof buf) == sizeof buf, "write \"src\"");
+
+  msg ("seek \"src\" to 200");
+  seek (src_fd, 200);
+  CHECK (copy_file_range (src_fd, dst_fd, 1000) == 100,
+         "copy past end of \"src\" copies 100 bytes");
+  CHECK (copy_file_range (src_fd, dst_fd, 1000) == 0,
+         "copy at end of \"src\" copies nothing");
+  msg ("seek \"src\" to 0");
+  seek (src_fd, 0);
+  CHECK (copy_file_range (src_fd, dst_fd, 0) == 0,
+         "copy of 0 bytes copies nothing");
+  CHECK (tell (src_fd) == 0, "\"src\" position still 0");
+  CHECK (copy_file_range (src_fd, 1234, 10) == -1,
+         "copy to bad fd fails");
+  CHECK (copy_file_range (1234, dst_fd, 10) == -1,
+         "copy from bad fd fails");
+  msg ("close \"src\"");
+  close (src_fd);
+  msg ("close \"dst\"");
+  close (dst_fd);
+
+  check_file ("dst", buf + 200, 100);
+}
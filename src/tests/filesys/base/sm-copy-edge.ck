@@ -0,0 +1,27 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sm-copy-edge) begin
+(sm-copy-edge) create "src"
+(sm-copy-edge) create "dst"
+(sm-copy-edge) open "src"
+(sm-copy-edge) open "dst"
+(sm-copy-edge) write "src"
+(sm-copy-edge) seek "src" to 200
+(sm-copy-edge) copy past end of "src" copies 100 bytes
+(sm-copy-edge) copy at end of "src" copies nothing
+(sm-copy-edge) seek "src" to 0
+(sm-copy-edge) copy of 0 bytes copies nothing
+(sm-copy-edge) "src" position still 0
+(sm-copy-edge) copy to bad fd fails
+(sm-copy-edge) copy from bad fd fails
+(sm-copy-edge) close "src"
+(sm-copy-edge) close "dst"
+(sm-copy-edge) open "dst" for verification
+(sm-copy-edge) verified contents of "dst"
+(sm-copy-edge) close "dst"
+(sm-copy-edge) end
+EOF
+pass;
@@ -0,0 +1,42 @@
+/* Opens a file twice and uses copy_file_range() to copy a range
+   of the file onto a range of itself that overlaps it, first
+   forward and then backward.  Both copies must fail with -1 and
+   leave the file and both positions alone. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[3000];
+
+void
+test_main (void) 
+{
+  const char *file_name = "overlap";
+  int fd1, fd2;
+
+  random_bytes (buf, sizeof buf);
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd1 = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (write (fd1, buf, sizeof buf) == sizeof buf,
+         "write \"%s\"", file_name);
+  CHECK ((fd2 = open (file_name)) > 1, "open \"%s\" again", file_name);
+
+  msg ("seek first \"%s\" to 0", file_name);
+  seek (fd1, 0);
+  msg ("seek second \"%s\" to 700", file_name);
+  seek (fd2, 700);
+  CHECK (copy_file_range (fd1, fd2, 2000) == -1,
+         "copy \"%s\" forward onto an overlapping range fails", file_name);
+  CHECK (copy_file_range (fd2, fd1, 2000) == -1,
+         "copy \"%s\" backward onto an overlapping range fails", file_name);
+  CHECK (tell (fd1) == 0, "first \"%s\" position still 0", file_name);
+  CHECK (tell (fd2) == 700, "second \"%s\" position still 700", file_name);
+  msg ("close \"%s\" twice", file_name);
+  close (fd1);
+  close (fd2);
+
+  check_file (file_name, buf, sizeof buf);
+}
@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sm-copy-overlap) begin
+(sm-copy-overlap) create "overlap"
+(sm-copy-overlap) open "overlap"
+(sm-copy-overlap) write "overlap"
+(sm-copy-overlap) open "overlap" again
+(sm-copy-overlap) seek first "overlap" to 0
+(sm-copy-overlap) seek second "overlap" to 700
+(sm-copy-overlap) copy "overlap" forward onto an overlapping range fails
+(sm-copy-overlap) copy "overlap" backward onto an overlapping range fails
+(sm-copy-overlap) first "overlap" position still 0
+(sm-copy-overlap) second "overlap" position still 700
+(sm-copy-overlap) close "overlap" twice
+(sm-copy-overlap) open "overlap" for verification
+(sm-copy-overlap) verified contents of "overlap"
+(sm-copy-overlap) close "overlap"
+(sm-copy-overlap) end
+EOF
+pass;
@@ -0,0 +1,34 @@
+/* Passes the same file descriptor to copy_file_range() as both
+   source and destination, which must fail with -1 and leave the
+   file and its position alone. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[3000];
+
+void
+test_main (void) 
+{
+  const char *file_name = "same";
+  int fd;
+
+  random_bytes (buf, sizeof buf);
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf,
+         "write \"%s\"", file_name);
+
+  msg ("seek \"%s\" to 0", file_name);
+  seek (fd, 0);
+  CHECK (copy_file_range (fd, fd, 1000) == -1,
+         "copy \"%s\" onto itself through one fd fails", file_name);
+  CHECK (tell (fd) == 0, "\"%s\" position still 0", file_name);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+
+  check_file (file_name, buf, sizeof buf);
+}
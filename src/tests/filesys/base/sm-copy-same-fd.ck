@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sm-copy-same-fd) begin
+(sm-copy-same-fd) create "same"
+(sm-copy-same-fd) open "same"
+(sm-copy-same-fd) write "same"
+(sm-copy-same-fd) seek "same" to 0
+(sm-copy-same-fd) copy "same" onto itself through one fd fails
+(sm-copy-same-fd) "same" position still 0
+(sm-copy-same-fd) close "same"
+(sm-copy-same-fd) open "same" for verification
+(sm-copy-same-fd) verified contents of "same"
+(sm-copy-same-fd) close "same"
+(sm-copy-same-fd) end
+EOF
+pass;
@@ -0,0 +1,41 @@
+/* Opens a file twice and uses copy_file_range() to append a copy
+   of the file to itself through the second descriptor.  Only the
+   data present when the copy started may be copied. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[3000];
+static char expected[sizeof buf * 2];
+
+void
+test_main (void) 
+{
+  const char *file_name = "self";
+  int fd1, fd2;
+
+  random_bytes (buf, sizeof buf);
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd1 = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (write (fd1, buf, sizeof buf) == sizeof buf,
+         "write \"%s\"", file_name);
+  CHECK ((fd2 = open (file_name)) > 1, "open \"%s\" again", file_name);
+  CHECK (fd1 != fd2, "open returned distinct fds");
+
+  msg ("seek first \"%s\" to 0", file_name);
+  seek (fd1, 0);
+  msg ("seek second \"%s\" to %zu", file_name, sizeof buf);
+  seek (fd2, sizeof buf);
+  CHECK (copy_file_range (fd1, fd2, sizeof expected) == sizeof buf,
+         "copy \"%s\" onto its own end", file_name);
+  msg ("close \"%s\" twice", file_name);
+  close (fd1);
+  close (fd2);
+
+  memcpy (expected, buf, sizeof buf);
+  memcpy (expected + sizeof buf, buf, sizeof buf);
+  check_file (file_name, expected, sizeof expected);
+}
@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sm-copy-self) begin
+(sm-copy-self) create "self"
+(sm-copy-self) open "self"
+(sm-copy-self) write "self"
+(sm-copy-self) open "self" again
+(sm-copy-self) open returned distinct fds
+(sm-copy-self) seek first "self" to 0
+(sm-copy-self) seek second "self" to 3000
+(sm-copy-self) copy "self" onto its own end
+(sm-copy-self) close "self" twice
+(sm-copy-self) open "self" for verification
+(sm-copy-self) verified contents of "self"
+(sm-copy-self) close "self"
+(sm-copy-self) end
+EOF
+pass;
@@ -0,0 +1,49 @@
+/* Copies part of a file into the middle of another with
+   copy_file_range(), starting at positions that are aligned
+   differently within a sector, so that the data must go through
+   a buffer.  The rest of the destination must be left alone. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SRC_OFS 300
+#define DST_OFS 1027
+#define COPY_CNT 2500
+
+static char src_buf[4000];
+static char dst_buf[5000];
+
+void
+test_main (void) 
+{
+  int src_fd, dst_fd;
+
+  random_bytes (src_buf, sizeof src_buf);
+  random_bytes (dst_buf, sizeof dst_buf);
+  CHECK (create ("src", 0), "create \"src\"");
+  CHECK (create ("dst", 0), "create \"dst\"");
+  CHECK ((src_fd = open ("src")) > 1, "open \"src\"");
+  CHECK ((dst_fd = open ("dst")) > 1, "open \"dst\"");
+  CHECK (write (src_fd, src_buf, sizeof src_buf) == sizeof src_buf,
+         "write \"src\"");
+  CHECK (write (dst_fd, dst_buf, sizeof dst_buf) == sizeof dst_buf,
+         "write \"dst\"");
+
+  msg ("seek \"src\" to %d and \"dst\" to %d", SRC_OFS, DST_OFS);
+  seek (src_fd, SRC_OFS);
+  seek (dst_fd, DST_OFS);
+  CHECK (copy_file_range (src_fd, dst_fd, COPY_CNT) == COPY_CNT,
+         "copy %d bytes from \"src\" to \"dst\"", COPY_CNT);
+  CHECK (tell (src_fd) == SRC_OFS + COPY_CNT, "\"src\" position advanced");
+  CHECK (tell (dst_fd) == DST_OFS + COPY_CNT, "\"dst\" position advanced");
+  msg ("close \"src\"");
+  close (src_fd);
+  msg ("close \"dst\"");
+  close (dst_fd);
+
+  memcpy (dst_buf + DST_OFS, src_buf + SRC_OFS, COPY_CNT);
+  check_file ("dst", dst_buf, sizeof dst_buf);
+}
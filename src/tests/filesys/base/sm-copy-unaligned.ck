@@ -0,0 +1,24 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sm-copy-unaligned) begin
+(sm-copy-unaligned) create "src"
+(sm-copy-unaligned) create "dst"
+(sm-copy-unaligned) open "src"
+(sm-copy-unaligned) open "dst"
+(sm-copy-unaligned) write "src"
+(sm-copy-unaligned) write "dst"
+(sm-copy-unaligned) seek "src" to 300 and "dst" to 1027
+(sm-copy-unaligned) copy 2500 bytes from "src" to "dst"
+(sm-copy-unaligned) "src" position advanced
+(sm-copy-unaligned) "dst" position advanced
+(sm-copy-unaligned) close "src"
+(sm-copy-unaligned) close "dst"
+(sm-copy-unaligned) open "dst" for verification
+(sm-copy-unaligned) verified contents of "dst"
+(sm-copy-unaligned) close "dst"
+(sm-copy-unaligned) end
+EOF
+pass;
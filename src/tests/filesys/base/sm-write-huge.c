@@ -0,0 +1,31 @@
+/* Writes to a small file at an offset near the largest off_t,
+   which must fail without extending or corrupting the file. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[100];
+
+void
+test_main (void) 
+{
+  const char *file_name = "huge";
+  char extra[32];
+  int fd;
+
+  random_bytes (buf, sizeof buf);
+  random_bytes (extra, sizeof extra);
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf,
+         "write \"%s\"", file_name);
+  msg ("seek \"%s\" to 0x7ffffff0", file_name);
+  seek (fd, 0x7ffffff0);
+  CHECK (write (fd, extra, sizeof extra) == 0,
+         "write past maximum file size fails");
+  msg ("close \"%s\"", file_name);
+  close (fd);
+  check_file (file_name, buf, sizeof buf);
+}
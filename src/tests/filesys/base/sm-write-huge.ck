@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sm-write-huge) begin
+(sm-write-huge) create "huge"
+(sm-write-huge) open "huge"
+(sm-write-huge) write "huge"
+(sm-write-huge) seek "huge" to 0x7ffffff0
+(sm-write-huge) write past maximum file size fails
+(sm-write-huge) close "huge"
+(sm-write-huge) open "huge" for verification
+(sm-write-huge) verified contents of "huge"
+(sm-write-huge) close "huge"
+(sm-write-huge) end
+EOF
+pass;
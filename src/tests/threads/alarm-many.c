@@ -0,0 +1,90 @@
+/* Creates 1,000 threads that each sleep once, spread over ten
+   different wake-up times, and verifies that none of them wakes
+   up early.
+
+   Sleeping threads should not use any CPU time, so most of this
+   test's ticks should show up as idle ticks in the statistics
+   printed at shutdown. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Number of sleeping threads. */
+#define THREAD_CNT 1000
+
+/* Number of distinct wake-up times, 10 ticks apart. */
+#define WAKEUP_CNT 10
+
+/* Information about one sleeper. */
+struct sleeper 
+  {
+    int64_t wakeup;             /* Tick at which to wake up. */
+    int64_t woke;               /* Tick at which it actually woke. */
+    struct semaphore *done;     /* Up'd once woken up. */
+  };
+
+static thread_func sleeper;
+
+void
+test_alarm_many (void) 
+{
+  struct sleeper *sleepers;
+  struct semaphore done;
+  int64_t start;
+  int early = 0;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  msg ("Creating %d threads to sleep until one of %d wake-up times.",
+       THREAD_CNT, WAKEUP_CNT);
+
+  sleepers = malloc (sizeof *sleepers * THREAD_CNT);
+  if (sleepers == NULL)
+    PANIC ("couldn't allocate memory for test");
+  sema_init (&done, 0);
+
+  start = timer_ticks ();
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      struct sleeper *s = &sleepers[i];
+      char name[16];
+
+      s->wakeup = start + (i % WAKEUP_CNT + 1) * 10;
+      s->woke = -1;
+      s->done = &done;
+      snprintf (name, sizeof name, "sleeper %d", i);
+      if (thread_create (name, PRI_DEFAULT, sleeper, s) == TID_ERROR)
+        fail ("creating thread %d failed", i);
+    }
+
+  for (i = 0; i < THREAD_CNT; i++)
+    sema_down (&done);
+
+  for (i = 0; i < THREAD_CNT; i++)
+    if (sleepers[i].woke < sleepers[i].wakeup)
+      early++;
+  if (early > 0)
+    fail ("%d of %d threads woke up early", early, THREAD_CNT);
+  msg ("All %d threads woke up on or after their wake-up time.",
+       THREAD_CNT);
+
+  free (sleepers);
+}
+
+/* Sleeper thread. */
+static void
+sleeper (void *s_) 
+{
+  struct sleeper *s = s_;
+
+  timer_sleep (s->wakeup - timer_ticks ());
+  s->woke = timer_ticks ();
+  sema_up (s->done);
+}
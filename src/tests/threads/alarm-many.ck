@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(alarm-many) begin
+(alarm-many) Creating 1000 threads to sleep until one of 10 wake-up times.
+(alarm-many) All 1000 threads woke up on or after their wake-up time.
+(alarm-many) end
+EOF
+pass;
@@ -0,0 +1,33 @@
+/* Passes positions to pread() and pwrite() that are negative
+   when taken as an offset or that lie far beyond the largest
+   possible file.  Negative positions must fail with -1, the
+   others must transfer nothing, and neither may move the file
+   position or change the file. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char buffer[16] = "0123456789abcdef";
+  int handle;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+
+  CHECK (pread (handle, buffer, sizeof buffer, 0x80000000) == -1,
+         "pread at negative position fails");
+  CHECK (pwrite (handle, buffer, sizeof buffer, 0x80000000) == -1,
+         "pwrite at negative position fails");
+  CHECK (pread (handle, buffer, sizeof buffer, 0x7ffffff0) == 0,
+         "pread at huge position reads nothing");
+  CHECK (pwrite (handle, buffer, sizeof buffer, 0x7ffffff0) == 0,
+         "pwrite at huge position writes nothing");
+  CHECK (tell (handle) == 0, "file position still 0");
+  msg ("close \"sample.txt\"");
+  close (handle);
+
+  check_file ("sample.txt", sample, sizeof sample - 1);
+}
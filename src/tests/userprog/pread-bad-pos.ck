@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pread-bad-pos) begin
+(pread-bad-pos) open "sample.txt"
+(pread-bad-pos) pread at negative position fails
+(pread-bad-pos) pwrite at negative position fails
+(pread-bad-pos) pread at huge position reads nothing
+(pread-bad-pos) pwrite at huge position writes nothing
+(pread-bad-pos) file position still 0
+(pread-bad-pos) close "sample.txt"
+(pread-bad-pos) open "sample.txt" for verification
+(pread-bad-pos) verified contents of "sample.txt"
+(pread-bad-pos) close "sample.txt"
+(pread-bad-pos) end
+pread-bad-pos: exit(0)
+EOF
+pass;
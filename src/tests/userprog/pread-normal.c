@@ -0,0 +1,27 @@
+/* Reads from the middle of a file with pread(), which must
+   return the data at the given position and leave the file
+   position alone. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char buffer[64];
+  int handle;
+  int byte_cnt;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+
+  seek (handle, 20);
+  byte_cnt = pread (handle, buffer, sizeof buffer, 100);
+  if (byte_cnt != sizeof buffer)
+    fail ("pread() returned %d instead of %zu", byte_cnt, sizeof buffer);
+  if (memcmp (buffer, sample + 100, sizeof buffer))
+    fail ("pread() returned the wrong data");
+  CHECK (tell (handle) == 20, "file position still 20");
+}
@@ -0,0 +1,32 @@
+/* Overwrites part of a file with pwrite(), which must write at
+   the given position, leave the file position alone, and leave
+   the rest of the file untouched. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  static const char patch[] = "Pintos";
+  char expected[sizeof sample - 1];
+  int handle;
+  int byte_cnt;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+
+  seek (handle, 5);
+  byte_cnt = pwrite (handle, patch, sizeof patch - 1, 50);
+  if (byte_cnt != sizeof patch - 1)
+    fail ("pwrite() returned %d instead of %zu", byte_cnt, sizeof patch - 1);
+  CHECK (tell (handle) == 5, "file position still 5");
+  msg ("close \"sample.txt\"");
+  close (handle);
+
+  memcpy (expected, sample, sizeof expected);
+  memcpy (expected + 50, patch, sizeof patch - 1);
+  check_file ("sample.txt", expected, sizeof expected);
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pwrite-normal) begin
+(pwrite-normal) open "sample.txt"
+(pwrite-normal) file position still 5
+(pwrite-normal) close "sample.txt"
+(pwrite-normal) open "sample.txt" for verification
+(pwrite-normal) verified contents of "sample.txt"
+(pwrite-normal) close "sample.txt"
+(pwrite-normal) end
+pwrite-normal: exit(0)
+EOF
+pass;
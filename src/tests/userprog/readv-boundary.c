@@ -0,0 +1,32 @@
+/* Reads a file with readv() into two buffers, the second of
+   which spans two pages in virtual address space.  This must
+   succeed. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/boundary.h"
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct iovec iov[2];
+  int handle;
+  int byte_cnt;
+  char *buffer;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+
+  buffer = get_boundary_area () - sizeof sample / 2;
+  iov[0].iov_base = buffer;
+  iov[0].iov_len = 100;
+  iov[1].iov_base = buffer + 100;
+  iov[1].iov_len = sizeof sample - 1 - 100;
+  byte_cnt = readv (handle, iov, 2);
+  if (byte_cnt != sizeof sample - 1)
+    fail ("readv() returned %d instead of %zu", byte_cnt, sizeof sample - 1);
+  else if (memcmp (sample, buffer, sizeof sample - 1))
+    fail ("expected text differs from actual");
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(readv-boundary) begin
+(readv-boundary) open "sample.txt"
+(readv-boundary) end
+readv-boundary: exit(0)
+EOF
+pass;
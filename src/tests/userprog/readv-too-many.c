@@ -0,0 +1,35 @@
+/* Passes readv() and writev() more than IOV_MAX buffers, and a
+   negative count, all of which must fail with -1 without
+   transferring anything. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  static struct iovec iov[IOV_MAX + 1];
+  char buffer[1];
+  int handle;
+  int i;
+
+  for (i = 0; i < IOV_MAX + 1; i++)
+    {
+      iov[i].iov_base = buffer;
+      iov[i].iov_len = sizeof buffer;
+    }
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (readv (handle, iov, IOV_MAX + 1) == -1,
+         "readv with IOV_MAX + 1 buffers fails");
+  CHECK (writev (handle, iov, IOV_MAX + 1) == -1,
+         "writev with IOV_MAX + 1 buffers fails");
+  CHECK (readv (handle, iov, -1) == -1, "readv with -1 buffers fails");
+  CHECK (tell (handle) == 0, "file position still 0");
+  msg ("close \"sample.txt\"");
+  close (handle);
+
+  check_file ("sample.txt", sample, sizeof sample - 1);
+}
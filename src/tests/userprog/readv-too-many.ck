@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(readv-too-many) begin
+(readv-too-many) open "sample.txt"
+(readv-too-many) readv with IOV_MAX + 1 buffers fails
+(readv-too-many) writev with IOV_MAX + 1 buffers fails
+(readv-too-many) readv with -1 buffers fails
+(readv-too-many) file position still 0
+(readv-too-many) close "sample.txt"
+(readv-too-many) open "sample.txt" for verification
+(readv-too-many) verified contents of "sample.txt"
+(readv-too-many) close "sample.txt"
+(readv-too-many) end
+readv-too-many: exit(0)
+EOF
+pass;
@@ -0,0 +1,24 @@
+/* Passes the writev system call a valid array of buffers, one
+   of which is an invalid pointer.
+   The process must be terminated with -1 exit code. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct iovec iov[2];
+  char buffer[16];
+  int handle;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+
+  iov[0].iov_base = buffer;
+  iov[0].iov_len = sizeof buffer;
+  iov[1].iov_base = (char *) 0xc0100000;
+  iov[1].iov_len = 123;
+  writev (handle, iov, 2);
+  fail ("should not have survived writev()");
+}
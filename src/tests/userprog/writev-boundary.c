@@ -0,0 +1,37 @@
+/* Writes to a file with writev(), passing an array of buffers
+   that itself spans two pages in virtual address space.  This
+   must succeed. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/boundary.h"
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char expected[sizeof sample - 1];
+  struct iovec *iov;
+  int handle;
+  int byte_cnt;
+
+  /* Swap the two halves of the sample as it is written. */
+  iov = (struct iovec *) get_boundary_area () - 1;
+  iov[0].iov_base = sample + 100;
+  iov[0].iov_len = sizeof sample - 1 - 100;
+  iov[1].iov_base = sample;
+  iov[1].iov_len = 100;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  byte_cnt = writev (handle, iov, 2);
+  if (byte_cnt != sizeof sample - 1)
+    fail ("writev() returned %d instead of %zu", byte_cnt, sizeof sample - 1);
+  msg ("close \"sample.txt\"");
+  close (handle);
+
+  memcpy (expected, sample + 100, sizeof sample - 1 - 100);
+  memcpy (expected + sizeof sample - 1 - 100, sample, 100);
+  check_file ("sample.txt", expected, sizeof expected);
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(writev-boundary) begin
+(writev-boundary) open "sample.txt"
+(writev-boundary) close "sample.txt"
+(writev-boundary) open "sample.txt" for verification
+(writev-boundary) verified contents of "sample.txt"
+(writev-boundary) close "sample.txt"
+(writev-boundary) end
+writev-boundary: exit(0)
+EOF
+pass;
@@ -34,9 +34,15 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/ramdisk.h"
+#include "devices/virtio-blk.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/swap.h"
+#endif
 
 /* Page directory with kernel mappings only. */
 uint32_t *init_page_dir;
@@ -52,6 +58,11 @@ static const char *scratch_bdev_name;
 #ifdef VM
 static const char *swap_bdev_name;
 #endif
+
+/* -rd, -rd-from: Size in kB of the RAM disk, and block device to
+   fill it from. */
+static size_t ramdisk_kb;
+static const char *ramdisk_source_name;
 #endif /* FILESYS */
 
 /* -ul: Maximum number of pages to put into palloc's user pool. */
@@ -98,6 +109,9 @@ main (void)
   palloc_init (user_page_limit);
   malloc_init ();
   paging_init ();
+#ifdef VM
+  frame_init ();
+#endif
 
   /* Segmentation. */
 #ifdef USERPROG
@@ -123,9 +137,14 @@ main (void)
 #ifdef FILESYS
   /* Initialize file system. */
   ide_init ();
+  virtio_blk_init ();
+  ramdisk_init (ramdisk_kb, ramdisk_source_name);
   locate_block_devices ();
   filesys_init (format_filesys);
 #endif
+#ifdef VM
+  swap_init ();
+#endif
 
   printf ("Boot complete.\n");
   
@@ -251,6 +270,10 @@ parse_options (char **argv)
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
 #endif
+      else if (!strcmp (name, "-rd"))
+        ramdisk_kb = atoi (value);
+      else if (!strcmp (name, "-rd-from"))
+        ramdisk_source_name = value;
 #endif
       else if (!strcmp (name, "-rs"))
         random_init (atoi (value));
@@ -376,6 +399,8 @@ usage (void)
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
+          "  -rd=SIZE           Create a SIZE kB RAM disk named rd.\n"
+          "  -rd-from=BDEV      Fill the RAM disk with a copy of BDEV.\n"
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
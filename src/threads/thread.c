@@ -11,18 +11,32 @@
 #include "threads/switch.h"
 #include "threads/vaddr.h"
 #include "threads/synch.h"
+#include "devices/timer.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
+#ifdef FILESYS
+#include "filesys/directory.h"
+#endif
 
 /* Random value for struct thread's `magic' member.
    Used to detect stack overflow.  See the big comment at the top
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Run queues of processes in THREAD_READY state, that is,
+   processes that are ready to run but not actually running.
+   There is one queue per priority level, each kept in FIFO
+   order. */
+#define PRI_CNT (PRI_MAX - PRI_MIN + 1)
+static struct list ready_queues[PRI_CNT];
+
+/* Bit P is set if and only if ready_queues[P] is nonempty, so
+   that the highest ready priority is found with a bit scan. */
+static uint64_t ready_mask;
+
+/* Number of threads in the run queues. */
+static int ready_cnt;
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
@@ -59,6 +73,14 @@ static unsigned thread_ticks;   /* # of timer ticks since last yield. */
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* MLFQS tuning. */
+#define NICE_MIN -20            /* Nicest value. */
+#define NICE_MAX 20             /* Least nice value. */
+#define PRIORITY_INTERVAL 4     /* # of ticks between priority updates. */
+
+/* System load average, for the MLFQS. */
+static fixed_t load_avg;
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
@@ -70,6 +92,13 @@ static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static void ready_insert (struct thread *);
+static void ready_remove (struct thread *);
+static int ready_max_priority (void);
+static void set_effective_priority (struct thread *, int priority);
+static void mlfqs_tick (struct thread *);
+static thread_action_func mlfqs_update;
+static int mlfqs_priority (const struct thread *);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -87,10 +116,16 @@ static tid_t allocate_tid (void);
 void
 thread_init (void) 
 {
+  int pri;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
+  for (pri = PRI_MIN; pri <= PRI_MAX; pri++)
+    list_init (&ready_queues[pri - PRI_MIN]);
+  ready_mask = 0;
+  ready_cnt = 0;
+  load_avg = 0;
   list_init (&all_list);
 
   /* Set up a thread structure for the running thread. */
@@ -134,11 +169,72 @@ thread_tick (void)
   else
     kernel_ticks++;
 
-  /* Enforce preemption. */
-  if (++thread_ticks >= TIME_SLICE)
+  if (thread_mlfqs)
+    mlfqs_tick (t);
+
+  /* Enforce preemption, either because the time slice ran out
+     or because a higher-priority thread became ready while
+     preemption was not possible. */
+  if (++thread_ticks >= TIME_SLICE || ready_max_priority () > t->priority)
     intr_yield_on_return ();
 }
 
+/* Updates the MLFQS statistics for timer tick and running
+   thread CUR.  Each tick only CUR's recent_cpu changes, so only
+   CUR's priority needs to be recomputed in between the once per
+   second updates of the load average and of every thread's
+   recent_cpu.  Runs in an external interrupt context. */
+static void
+mlfqs_tick (struct thread *cur)
+{
+  int64_t ticks = timer_ticks ();
+
+  if (cur != idle_thread)
+    cur->recent_cpu = fp_add_int (cur->recent_cpu, 1);
+
+  if (ticks % TIMER_FREQ == 0)
+    {
+      int ready_threads = ready_cnt + (cur != idle_thread);
+      fixed_t decay;
+
+      load_avg = (fp_mul (fp_div (fp_from_int (59), fp_from_int (60)),
+                          load_avg)
+                  + fp_from_int (ready_threads) / 60);
+      decay = fp_div (2 * load_avg, fp_add_int (2 * load_avg, 1));
+      thread_foreach (mlfqs_update, &decay);
+    }
+  else if (ticks % PRIORITY_INTERVAL == 0 && cur != idle_thread)
+    set_effective_priority (cur, mlfqs_priority (cur));
+}
+
+/* Decays T's recent_cpu by the factor *DECAY_ and recomputes
+   T's priority.  Used once per second by mlfqs_tick(). */
+static void
+mlfqs_update (struct thread *t, void *decay_)
+{
+  const fixed_t *decay = decay_;
+
+  if (t == idle_thread)
+    return;
+  t->recent_cpu = fp_add_int (fp_mul (*decay, t->recent_cpu), t->nice);
+  set_effective_priority (t, mlfqs_priority (t));
+}
+
+/* Returns the MLFQS priority for T, based on its recent_cpu and
+   nice values. */
+static int
+mlfqs_priority (const struct thread *t)
+{
+  int priority = fp_trunc (fp_from_int (PRI_MAX - t->nice * 2)
+                           - t->recent_cpu / 4);
+
+  if (priority < PRI_MIN)
+    priority = PRI_MIN;
+  else if (priority > PRI_MAX)
+    priority = PRI_MAX;
+  return priority;
+}
+
 /* Prints thread statistics. */
 void
 thread_print_stats (void) 
@@ -157,11 +253,9 @@ thread_print_stats (void)
    before thread_create() returns.  Contrariwise, the original
    thread may run for any amount of time before the new thread is
    scheduled.  Use a semaphore or some other form of
-   synchronization if you need to ensure ordering.
-
-   The code provided sets the new thread's `priority' member to
-   PRIORITY, but no actual priority scheduling is implemented.
-   Priority scheduling is the goal of Problem 1-3. */
+   synchronization if you need to ensure ordering.  In
+   particular, if PRIORITY is higher than the running thread's,
+   the new thread runs before thread_create() returns. */
 tid_t
 thread_create (const char *name, int priority,
                thread_func *function, void *aux) 
@@ -184,6 +278,12 @@ thread_create (const char *name, int priority,
   init_thread (t, name, priority);
   tid = t->tid = allocate_tid ();
 
+#ifdef FILESYS
+  /* Start out in the creator's current directory. */
+  if (thread_current ()->cwd != NULL)
+    t->cwd = dir_reopen (thread_current ()->cwd);
+#endif
+
   /* Prepare thread for first run by initializing its stack.
      Do this atomically so intermediate values for the 'stack' 
      member cannot be observed. */
@@ -232,10 +332,12 @@ thread_block (void)
    This is an error if T is not blocked.  (Use thread_yield() to
    make the running thread ready.)
 
-   This function does not preempt the running thread.  This can
-   be important: if the caller had disabled interrupts itself,
-   it may expect that it can atomically unblock a thread and
-   update other data. */
+   If T has a higher priority than the running thread, the
+   running thread is preempted, but only if the caller had
+   interrupts turned on or is an interrupt handler.  This can be
+   important: if the caller had disabled interrupts itself, it
+   may expect that it can atomically unblock a thread and update
+   other data. */
 void
 thread_unblock (struct thread *t) 
 {
@@ -245,9 +347,35 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back (&ready_list, &t->elem);
+  ready_insert (t);
   t->status = THREAD_READY;
   intr_set_level (old_level);
+
+  thread_preempt ();
+}
+
+/* Yields the CPU if a ready thread has a higher priority than
+   the running thread.  Within an interrupt handler, the yield
+   happens on return from the interrupt.  Does nothing if the
+   caller has turned interrupts off, since it may be relying on
+   running atomically; thread_tick() catches up with the
+   preemption within a tick. */
+void
+thread_preempt (void)
+{
+  if (intr_context ())
+    {
+      if (ready_max_priority () > thread_current ()->priority)
+        intr_yield_on_return ();
+    }
+  else if (intr_get_level () == INTR_ON)
+    {
+      enum intr_level old_level = intr_disable ();
+      bool preempt = ready_max_priority () > thread_current ()->priority;
+      intr_set_level (old_level);
+      if (preempt)
+        thread_yield ();
+    }
 }
 
 /* Returns the name of the running thread. */
@@ -316,7 +444,7 @@ thread_yield (void)
 
   old_level = intr_disable ();
   if (cur != idle_thread) 
-    list_push_back (&ready_list, &cur->elem);
+    ready_insert (cur);
   cur->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
@@ -339,11 +467,89 @@ thread_foreach (thread_action_func *func, void *aux)
     }
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Sets the current thread's base priority to NEW_PRIORITY,
+   yielding if it no longer has the highest priority.  While
+   other threads donate a higher priority, the donation stays in
+   effect.  Ignored by the MLFQS, which sets priorities itself. */
 void
 thread_set_priority (int new_priority) 
 {
-  thread_current ()->priority = new_priority;
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (PRI_MIN <= new_priority && new_priority <= PRI_MAX);
+
+  if (thread_mlfqs)
+    return;
+
+  old_level = intr_disable ();
+  cur->base_priority = new_priority;
+  thread_update_priority (cur);
+  intr_set_level (old_level);
+
+  thread_preempt ();
+}
+
+/* Raises T's effective priority to PRIORITY, if it is lower.
+   Used by lock_acquire() to donate priority to a lock holder.
+   Interrupts must be off. */
+void
+thread_donate_priority (struct thread *t, int priority)
+{
+  ASSERT (is_thread (t));
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t->priority < priority)
+    set_effective_priority (t, priority);
+}
+
+/* Recomputes T's effective priority as the maximum of its base
+   priority and the priorities of the threads waiting for locks
+   that T holds.  Interrupts must be off. */
+void
+thread_update_priority (struct thread *t)
+{
+  struct list_elem *le;
+  int priority = t->base_priority;
+
+  ASSERT (is_thread (t));
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (le = list_begin (&t->locks); le != list_end (&t->locks);
+       le = list_next (le))
+    {
+      struct lock *lock = list_entry (le, struct lock, elem);
+      struct list *waiters = &lock->semaphore.waiters;
+      struct list_elem *we;
+
+      for (we = list_begin (waiters); we != list_end (waiters);
+           we = list_next (we))
+        {
+          struct thread *w = list_entry (we, struct thread, elem);
+          if (w->priority > priority)
+            priority = w->priority;
+        }
+    }
+
+  if (t->priority != priority)
+    set_effective_priority (t, priority);
+}
+
+/* Sets T's effective priority to PRIORITY, moving T to the
+   matching run queue if it is ready.  Interrupts must be off. */
+static void
+set_effective_priority (struct thread *t, int priority)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t->status == THREAD_READY)
+    {
+      ready_remove (t);
+      t->priority = priority;
+      ready_insert (t);
+    }
+  else
+    t->priority = priority;
 }
 
 /* Returns the current thread's priority. */
@@ -353,37 +559,58 @@ thread_get_priority (void)
   return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE and recomputes
+   its priority, yielding if it no longer has the highest
+   priority. */
 void
-thread_set_nice (int nice UNUSED) 
+thread_set_nice (int nice) 
 {
-  /* Not yet implemented. */
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  if (nice < NICE_MIN)
+    nice = NICE_MIN;
+  else if (nice > NICE_MAX)
+    nice = NICE_MAX;
+
+  old_level = intr_disable ();
+  cur->nice = nice;
+  if (thread_mlfqs)
+    set_effective_priority (cur, mlfqs_priority (cur));
+  intr_set_level (old_level);
+
+  thread_preempt ();
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int load_avg_100 = fp_round (load_avg * 100);
+  intr_set_level (old_level);
+
+  return load_avg_100;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int recent_cpu_100 = fp_round (thread_current ()->recent_cpu * 100);
+  intr_set_level (old_level);
+
+  return recent_cpu_100;
 }
-
+
 /* Idle thread.  Executes when no other thread is ready to run.
 
    The idle thread is initially put on the ready list by
@@ -398,6 +625,11 @@ idle (void *idle_started_ UNUSED)
 {
   struct semaphore *idle_started = idle_started_;
   idle_thread = thread_current ();
+
+  /* The MLFQS gave us a priority in init_thread(), but the idle
+     thread must never outrank a ready thread. */
+  idle_thread->priority = idle_thread->base_priority = PRI_MIN;
+
   sema_up (idle_started);
 
   for (;;) 
@@ -467,7 +699,22 @@ init_thread (struct thread *t, const char *name, int priority)
   t->status = THREAD_BLOCKED;
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
-  t->priority = priority;
+  t->priority = t->base_priority = priority;
+  list_init (&t->locks);
+  t->wait_lock = NULL;
+#ifdef VM
+  list_init (&t->mappings);
+  t->next_mapid = 0;
+#endif
+  if (thread_mlfqs)
+    {
+      /* Inherit the creator's MLFQS statistics.  The initial
+         thread is its own creator, and it has just been zeroed. */
+      struct thread *parent = running_thread ();
+      t->nice = parent->nice;
+      t->recent_cpu = parent->recent_cpu;
+      t->priority = t->base_priority = mlfqs_priority (t);
+    }
   t->magic = THREAD_MAGIC;
   list_push_back (&all_list, &t->allelem);
 }
@@ -485,18 +732,78 @@ alloc_frame (struct thread *t, size_t size)
   return t->stack;
 }
 
+/* Adds T to the back of the run queue for its priority.
+   Interrupts must be off. */
+static void
+ready_insert (struct thread *t)
+{
+  int idx = t->priority - PRI_MIN;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  list_push_back (&ready_queues[idx], &t->elem);
+  ready_mask |= (uint64_t) 1 << idx;
+  ready_cnt++;
+}
+
+/* Removes ready thread T from its run queue.  Interrupts must
+   be off. */
+static void
+ready_remove (struct thread *t)
+{
+  int idx = t->priority - PRI_MIN;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->status == THREAD_READY);
+
+  list_remove (&t->elem);
+  if (list_empty (&ready_queues[idx]))
+    ready_mask &= ~((uint64_t) 1 << idx);
+  ready_cnt--;
+}
+
+/* Returns the highest priority among the threads in the run
+   queues, or PRI_MIN - 1 if they are all empty. */
+static int
+ready_max_priority (void)
+{
+  uint32_t hi = ready_mask >> 32;
+  uint32_t lo = ready_mask;
+
+  if (hi != 0)
+    return PRI_MIN + 63 - __builtin_clz (hi);
+  else if (lo != 0)
+    return PRI_MIN + 31 - __builtin_clz (lo);
+  else
+    return PRI_MIN - 1;
+}
+
 /* Chooses and returns the next thread to be scheduled.  Should
    return a thread from the run queue, unless the run queue is
    empty.  (If the running thread can continue running, then it
    will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+   idle_thread.
+
+   The thread chosen is the one at the front of the highest
+   priority nonempty queue, found in constant time from
+   ready_mask. */
 static struct thread *
 next_thread_to_run (void) 
 {
-  if (list_empty (&ready_list))
+  int idx;
+  struct list *queue;
+  struct thread *next;
+
+  if (ready_mask == 0)
     return idle_thread;
-  else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+
+  idx = ready_max_priority () - PRI_MIN;
+  queue = &ready_queues[idx];
+  next = list_entry (list_pop_front (queue), struct thread, elem);
+  if (list_empty (queue))
+    ready_mask &= ~((uint64_t) 1 << idx);
+  ready_cnt--;
+  return next;
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -4,6 +4,8 @@
 #include <debug.h>
 #include <list.h>
 #include <stdint.h>
+#include <hash.h>
+#include "threads/fixed-point.h"
 #include "userprog/fdt.h"
 
 /* States in a thread's life cycle. */
@@ -39,6 +41,11 @@ struct exitstatus
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* The scheduler tracks nonempty run queues in a 64-bit mask. */
+#if PRI_MAX - PRI_MIN + 1 > 64
+#error At most 64 priority levels are supported
+#endif
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -89,12 +96,13 @@ struct exitstatus
    the `magic' member of the running thread's `struct thread' is
    set to THREAD_MAGIC.  Stack overflow will normally change this
    value, triggering the assertion. */
-/* The `elem' member has a dual purpose.  It can be an element in
-   the run queue (thread.c), or it can be an element in a
-   semaphore wait list (synch.c).  It can be used these two ways
-   only because they are mutually exclusive: only a thread in the
-   ready state is on the run queue, whereas only a thread in the
-   blocked state is on a semaphore wait list. */
+/* The `elem' member has a triple purpose.  It can be an element
+   in the run queue (thread.c), an element in a semaphore wait
+   list (synch.c), or an element in the sleep list (timer.c).  It
+   can be used these ways only because they are mutually
+   exclusive: only a thread in the ready state is on the run
+   queue, whereas only a thread in the blocked state is on a
+   semaphore wait list or the sleep list, and never both. */
 struct thread
   {
     /* Owned by thread.c. */
@@ -102,8 +110,16 @@ struct thread
     enum thread_status status;          /* Thread state. */
     char name[32];                      /* Name (for debugging purposes). */
     uint8_t *stack;                     /* Saved stack pointer. */
-    int priority;                       /* Priority. */
+    int priority;                       /* Effective priority. */
+    int base_priority;                  /* Priority before donation. */
     struct list_elem allelem;           /* List element for all threads list. */
+    int64_t wakeup_tick;                /* Tick to wake up at (timer.c). */
+    int nice;                           /* Niceness, for the MLFQS. */
+    fixed_t recent_cpu;                 /* Recent CPU time, for the MLFQS. */
+
+    /* Shared between thread.c and synch.c. */
+    struct list locks;                  /* Locks held, for donation. */
+    struct lock *wait_lock;             /* Lock being waited for, if any. */
 
     // ------------ System Call ------------
 	int numchild;
@@ -120,6 +136,21 @@ struct thread
     fdt_t fdt;                          /* File Descriptor Table */
 #endif
 
+#ifdef FILESYS
+    /* Owned by filesys/filesys.c. */
+    struct dir *cwd;                    /* Current directory, null for root. */
+#endif
+
+#ifdef VM
+    /* Owned by vm/page.c. */
+    struct hash pages;                  /* Supplemental page table. */
+    void *user_esp;                     /* User esp on entry to kernel. */
+
+    /* Owned by vm/mmap.c. */
+    struct list mappings;               /* Memory mappings. */
+    int next_mapid;                     /* Identifier for next mapping. */
+#endif
+
     /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
   };
@@ -147,6 +178,10 @@ const char *thread_name (void);
 
 void thread_exit (void) NO_RETURN;
 void thread_yield (void);
+void thread_preempt (void);
+
+void thread_donate_priority (struct thread *, int priority);
+void thread_update_priority (struct thread *);
 
 /* Performs some operation on thread t, given auxiliary data AUX. */
 typedef void thread_action_func (struct thread *t, void *aux);
@@ -4,7 +4,11 @@
 #include "userprog/gdt.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
 #include "userprog/syscall.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
@@ -149,9 +153,20 @@ page_fault (struct intr_frame *f)
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
-  /* To implement virtual memory, delete the rest of the function
-     body, and replace it with code that brings in the page to
-     which fault_addr refers. */
+#ifdef VM
+  /* Bring in the page, if it belongs to the process, or grow the
+     stack to cover it.  The kernel may fault here too, while it
+     accesses user memory on a process's behalf; then the user
+     stack pointer is the one saved on entry to the system call. */
+  if (not_present && is_user_vaddr (fault_addr)
+      && thread_current ()->pagedir != NULL)
+    {
+      void *esp = user ? f->esp : thread_current ()->user_esp;
+      if (page_in (fault_addr) || page_grow_stack (fault_addr, esp))
+        return;
+    }
+#endif
+
   //printf ("Page fault at %p: %s error %s page in %s context.\n",
   //        fault_addr,
   //        not_present ? "not present" : "rights violation",
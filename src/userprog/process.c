@@ -20,6 +20,10 @@
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "userprog/fdt.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
 
 #define MAX_NAME_LEN 32
 #define MAX_NUM_BYTES 4080
@@ -171,6 +175,10 @@ process_exit (void)
 
 	file_close(thread_current()->file);
 	fdt_destroy(cur->fdt);
+#ifdef FILESYS
+	dir_close(cur->cwd);
+	cur->cwd = NULL;
+#endif
 
 	uint32_t *pd;
 	/* Destroy the current process's page directory and switch back
@@ -185,6 +193,10 @@ process_exit (void)
 		   directory before destroying the process's page
 		   directory, or our active page directory will be one
 		   that's been freed (and cleared). */
+#ifdef VM
+		mmap_unmap_all ();
+		page_table_destroy ();
+#endif
 		cur->pagedir = NULL;
 		pagedir_activate (NULL);
 		pagedir_destroy (pd);
@@ -299,6 +311,14 @@ load (const char *file_name, void (**eip) (void), void **esp)
 	}
 	fname[i] = '\0';
 
+#ifdef VM
+	/* Allocate the supplemental page table.  It must exist
+	   whenever the page directory does, so that process_exit()
+	   can tear down both. */
+	if (!page_table_init ())
+		goto done;
+#endif
+
 	/* Allocate and activate page directory. */
 	t->pagedir = pagedir_create ();
 	if (t->pagedir == NULL) 
@@ -491,6 +511,10 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
    The pages initialized by this function must be writable by the
    user process if WRITABLE is true, read-only otherwise.
 
+   With virtual memory, nothing is read here: each page is
+   recorded in the supplemental page table and read from FILE on
+   its first page fault.
+
    Return true if successful, false if a memory allocation error
    or disk read error occurs. */
 	static bool
@@ -501,7 +525,9 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 	ASSERT (pg_ofs (upage) == 0);
 	ASSERT (ofs % PGSIZE == 0);
 
+#ifndef VM
 	file_seek (file, ofs);
+#endif
 	while (read_bytes > 0 || zero_bytes > 0) 
 	{
 		/* Calculate how to fill this page.
@@ -510,6 +536,17 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
 		size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
+#ifdef VM
+		/* Record where the page's contents are. */
+		if (page_read_bytes > 0)
+		{
+			if (!page_add_file (upage, file, ofs, page_read_bytes, writable))
+				return false;
+		}
+		else if (!page_add_zero (upage, writable))
+			return false;
+		ofs += page_read_bytes;
+#else
 		/* Get a page of memory. */
 		uint8_t *kpage = palloc_get_page (PAL_USER);
 		if (kpage == NULL)
@@ -529,6 +566,7 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 			palloc_free_page (kpage);
 			return false; 
 		}
+#endif
 
 		/* Advance. */
 		read_bytes -= page_read_bytes;
@@ -546,6 +584,18 @@ setup_stack (void **esp)
 	uint8_t *kpage;
 	bool success = false;
 
+#ifdef VM
+	/* The arguments are pushed right away, so bring the page in
+	   now rather than on the first fault. */
+	void *upage = ((uint8_t *) PHYS_BASE) - PGSIZE;
+	if (page_add_zero (upage, true) && page_in (upage))
+	{
+		*esp = PHYS_BASE;
+		success = true;
+	}
+	return success;
+#endif
+
 	kpage = palloc_get_page (PAL_USER | PAL_ZERO);
 	if (kpage != NULL) 
 	{
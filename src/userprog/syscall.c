@@ -2,6 +2,7 @@
 #include <stdint.h>
 #include <syscall-nr.h>
 #include <string.h>
+#include <uio.h>
 #include "userprog/syscall.h"
 #include "userprog/pagedir.h"
 #include "userprog/process.h"
@@ -13,8 +14,14 @@
 #include "threads/malloc.h"
 #include "devices/shutdown.h"
 #include "devices/input.h"
+#include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#endif
 
 #define user_return(val) frame->eax = val; return
 #define MAX_SIZE 256
@@ -38,14 +45,13 @@ bool ignore_remove(tid_t id);
 // User Memory Check
 static bool check_uptr(const void* uptr);
 static bool check_buffer(const char* uptr, unsigned length);
+static bool check_buffer_pages(const void* uptr, unsigned length);
 static uintptr_t next_value(uintptr_t** sp);
 static char* next_charptr(uintptr_t** sp);
 static void* next_ptr(uintptr_t** sp);
 
 // Locks
 static struct lock exec_lock;
-static struct lock filecreate_lock;
-static struct lock fileremove_lock;
 
 // Syscall Functions
 static void sysclose(int fd);
@@ -58,6 +64,20 @@ static void sysremove(struct intr_frame* frame, const char* file);
 static void sysseek(int fd, unsigned position);
 static void systell(struct intr_frame *frame, int fd);
 static void syswrite(struct intr_frame *frame, int fd, const void *buffer, unsigned size);
+static void syschdir(struct intr_frame *frame, const char *dir);
+static void sysmkdir(struct intr_frame *frame, const char *dir);
+static void sysreaddir(struct intr_frame *frame, int fd, char *name);
+static void sysisdir(struct intr_frame *frame, int fd);
+static void sysinumber(struct intr_frame *frame, int fd);
+static void syspread(struct intr_frame *frame, int fd, void *buffer, unsigned size, unsigned position);
+static void syspwrite(struct intr_frame *frame, int fd, const void *buffer, unsigned size, unsigned position);
+static void sysvector(struct intr_frame *frame, int fd, const struct iovec *iov, int iovcnt, bool write);
+static void syscopy(struct intr_frame *frame, int in_fd, int out_fd, unsigned length);
+static int file_io(struct file *file, void *buffer, unsigned size, off_t position, bool write);
+#ifdef VM
+static void sysmmap(struct intr_frame *frame, int fd, void *addr);
+static void sysmunmap(mapid_t mapid);
+#endif
 
 /* Determine whether user process pointer is valid;
    Otherwise, return false*/ 
@@ -73,6 +93,12 @@ check_uptr (const void* uptr)
 			{
 				return true;
 			}
+#ifdef VM
+			/* Not resident yet, but it may belong to the process
+			   or be a valid extension of its stack. */
+			return page_in(uptr)
+				|| page_grow_stack(uptr, thread_current()->user_esp);
+#endif
 		}
 	} 
 	return false;
@@ -91,6 +117,27 @@ check_buffer (const char* uptr, unsigned length)
 	return true;
 }
 
+/* Determine whether the user buffer of LENGTH bytes at UPTR is
+   valid, checking one address in each page it spans rather than
+   every byte */
+static bool
+check_buffer_pages (const void* uptr, unsigned length)
+{
+	const uint8_t* p = uptr;
+	const uint8_t* end = p + length;
+
+	if(length == 0)
+		return true;
+	if(end < p)
+		return false;
+	for(; p < end; p = (const uint8_t*) pg_round_down(p) + PGSIZE)
+	{
+		if(!check_uptr(p))
+			return false;
+	}
+	return true;
+}
+
 void
 syscall_init (void) 
 {
@@ -101,8 +148,6 @@ syscall_init (void)
 	// Initialize Private Locks
 	sema_init(&exec_load_sema, 0);
 	lock_init(&exec_lock);
-	lock_init(&filecreate_lock);
-	lock_init(&fileremove_lock);
 
 	intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
 }
@@ -119,6 +164,10 @@ syscall_handler (struct intr_frame* frame)
 	// ----------------------------------------------
 	uintptr_t* kpaddr_sp = (uintptr_t*) frame->esp;
 	int syscall_num = -1;
+#ifdef VM
+	// Page faults in the kernel need the user stack pointer
+	thread_current()->user_esp = frame->esp;
+#endif
 	if(check_uptr(kpaddr_sp))
 		syscall_num = next_value(&kpaddr_sp);
 	else
@@ -337,6 +386,155 @@ syscall_handler (struct intr_frame* frame)
 				sysclose(fd);
 			}
 			break;
+		case SYS_CHDIR:
+			{
+				//bool chdir (const char *dir);
+				const char* dir =  next_charptr(&kpaddr_sp);
+				if(dir == NULL)
+					sysexit(-1);
+
+				unsigned len = strlen(dir);
+				if(!check_buffer(dir, len))
+					sysexit(-1);
+
+				syschdir(frame, dir);
+			}
+			break;
+		case SYS_MKDIR:
+			{
+				//bool mkdir (const char *dir);
+				const char* dir =  next_charptr(&kpaddr_sp);
+				if(dir == NULL)
+					sysexit(-1);
+
+				unsigned len = strlen(dir);
+				if(!check_buffer(dir, len))
+					sysexit(-1);
+
+				sysmkdir(frame, dir);
+			}
+			break;
+		case SYS_READDIR:
+			{
+				//bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
+				int fd = 0;
+				if (check_uptr(kpaddr_sp))
+					fd = (int) next_value(&kpaddr_sp);
+				else
+					sysexit(-1);
+
+				char* name = next_charptr(&kpaddr_sp);
+				if(name == NULL || !check_buffer(name, NAME_MAX + 1))
+					sysexit(-1);
+
+				sysreaddir(frame, fd, name);
+			}
+			break;
+		case SYS_ISDIR:
+			{
+				//bool isdir (int fd);
+				int fd = 0;
+				if (check_uptr(kpaddr_sp))
+					fd = (int) next_value(&kpaddr_sp);
+				else
+					sysexit(-1);
+
+				sysisdir(frame, fd);
+			}
+			break;
+		case SYS_INUMBER:
+			{
+				//int inumber (int fd);
+				int fd = 0;
+				if (check_uptr(kpaddr_sp))
+					fd = (int) next_value(&kpaddr_sp);
+				else
+					sysexit(-1);
+
+				sysinumber(frame, fd);
+			}
+			break;
+		case SYS_PREAD:
+		case SYS_PWRITE:
+			{
+				//int pread (int fd, void *buffer, unsigned length, unsigned position);
+				//int pwrite (int fd, const void *buffer, unsigned length, unsigned position);
+				if(!check_buffer_pages(kpaddr_sp, 4 * sizeof *kpaddr_sp))
+					sysexit(-1);
+
+				int fd = (int) next_value(&kpaddr_sp);
+				void* buffer = (void*) next_value(&kpaddr_sp);
+				unsigned length = (unsigned) next_value(&kpaddr_sp);
+				unsigned position = (unsigned) next_value(&kpaddr_sp);
+				if(!check_buffer_pages(buffer, length))
+					sysexit(-1);
+
+				if(syscall_num == SYS_PREAD)
+					syspread(frame, fd, buffer, length, position);
+				else
+					syspwrite(frame, fd, buffer, length, position);
+			}
+			break;
+		case SYS_READV:
+		case SYS_WRITEV:
+			{
+				//int readv (int fd, const struct iovec *iov, int iovcnt);
+				//int writev (int fd, const struct iovec *iov, int iovcnt);
+				if(!check_buffer_pages(kpaddr_sp, 3 * sizeof *kpaddr_sp))
+					sysexit(-1);
+
+				int fd = (int) next_value(&kpaddr_sp);
+				const struct iovec* iov = (const struct iovec*) next_value(&kpaddr_sp);
+				int iovcnt = (int) next_value(&kpaddr_sp);
+
+				sysvector(frame, fd, iov, iovcnt, syscall_num == SYS_WRITEV);
+			}
+			break;
+		case SYS_COPY_FILE_RANGE:
+			{
+				//int copy_file_range (int in_fd, int out_fd, unsigned length);
+				if(!check_buffer_pages(kpaddr_sp, 3 * sizeof *kpaddr_sp))
+					sysexit(-1);
+
+				int in_fd = (int) next_value(&kpaddr_sp);
+				int out_fd = (int) next_value(&kpaddr_sp);
+				unsigned length = (unsigned) next_value(&kpaddr_sp);
+
+				syscopy(frame, in_fd, out_fd, length);
+			}
+			break;
+#ifdef VM
+		case SYS_MMAP:
+			{
+				//mapid_t mmap (int fd, void *addr);
+				int fd = 0;
+				if (check_uptr(kpaddr_sp))
+					fd = (int) next_value(&kpaddr_sp);
+				else
+					sysexit(-1);
+
+				void *addr = NULL;
+				if (check_uptr(kpaddr_sp))
+					addr = (void *) next_value(&kpaddr_sp);
+				else
+					sysexit(-1);
+
+				sysmmap(frame, fd, addr);
+			}
+			break;
+		case SYS_MUNMAP:
+			{
+				//void munmap (mapid_t mapid);
+				mapid_t mapid = 0;
+				if (check_uptr(kpaddr_sp))
+					mapid = (mapid_t) next_value(&kpaddr_sp);
+				else
+					sysexit(-1);
+
+				sysmunmap(mapid);
+			}
+			break;
+#endif
 		default:
 			{
 				printf("Unrecognized System Call\n");
@@ -445,10 +643,7 @@ sysclose(int fd)
 static void
 syscreate(struct intr_frame* frame, const char* file, unsigned size)
 {
-	lock_acquire(&filecreate_lock);
-	bool result = filesys_create(file, size);
-	frame->eax = result;
-	lock_release(&filecreate_lock);
+	frame->eax = filesys_create(file, size);
 }
 
 static void
@@ -506,6 +701,14 @@ sysopen(struct intr_frame *frame, const char *file)
 static void
 sysread(struct intr_frame *frame, int fd, void *buffer, unsigned size)
 {
+	/* Checking each page also grows the stack to cover BUFFER. */
+	if(!check_buffer_pages(buffer, size))
+		sysexit(-1);
+#ifdef VM
+	if(!page_writable(buffer, size))
+		sysexit(-1);
+#endif
+
 	// special case
 	if (fd == STDIN_FILENO) 
 	{
@@ -521,23 +724,20 @@ sysread(struct intr_frame *frame, int fd, void *buffer, unsigned size)
 
 	struct file *file = fd_get_file(fd);
 
-	if (file == NULL) 
+	if (file == NULL || inode_is_dir(file_get_inode(file))) 
 	{
 		user_return(-1);
 	}
 	else 
 	{
-		user_return( file_read(file, buffer, size) );
+		user_return( file_io(file, buffer, size, -1, false) );
 	}
 }
 
 static void 
 sysremove(struct intr_frame* frame, const char* file)
 {
-	lock_acquire(&fileremove_lock);
-	bool result = filesys_remove(file);
-	frame->eax = result;
-	lock_release(&fileremove_lock);
+	frame->eax = filesys_remove(file);
 }
 
 static void
@@ -571,15 +771,256 @@ syswrite(struct intr_frame *frame, int fd, const void *buffer, unsigned size)
 {
 	struct file *file = fd_get_file(fd);
 
-	if (file == NULL) 
+	if (file == NULL || inode_is_dir(file_get_inode(file))) 
 	{
 		user_return(-1);
 	}
 	else 
 	{
-		user_return( file_write(file, buffer, size) );
+		user_return( file_io(file, (void *) buffer, size, -1, true) );
+	}
+}
+
+/* Reads SIZE bytes from FD at POSITION into BUFFER without moving
+   the file's own position. */
+static void
+syspread(struct intr_frame *frame, int fd, void *buffer, unsigned size, unsigned position)
+{
+	struct file *file = fd_get_file(fd);
+
+	if (file == NULL || inode_is_dir(file_get_inode(file)) || (off_t) position < 0)
+	{
+		user_return(-1);
+	}
+	else
+	{
+		user_return( file_io(file, buffer, size, position, false) );
+	}
+}
+
+/* Writes SIZE bytes from BUFFER to FD at POSITION without moving
+   the file's own position. */
+static void
+syspwrite(struct intr_frame *frame, int fd, const void *buffer, unsigned size, unsigned position)
+{
+	struct file *file = fd_get_file(fd);
+
+	if (file == NULL || inode_is_dir(file_get_inode(file)) || (off_t) position < 0)
+	{
+		user_return(-1);
+	}
+	else
+	{
+		user_return( file_io(file, (void *) buffer, size, position, true) );
+	}
+}
+
+/* Reads into, or if WRITE writes from, each of the IOVCNT buffers
+   in IOV in turn at FD's position, stopping at the first short
+   transfer, and returns the total number of bytes transferred.
+   The vector is copied in once and each buffer is checked once
+   per page. */
+static void
+sysvector(struct intr_frame *frame, int fd, const struct iovec *iov, int iovcnt, bool write)
+{
+	struct iovec kiov[IOV_MAX];
+	int total = 0;
+	int i;
+
+	if(iovcnt < 0 || iovcnt > IOV_MAX)
+	{
+		user_return(-1);
+	}
+	if(!check_buffer_pages(iov, iovcnt * sizeof *iov))
+		sysexit(-1);
+	memcpy(kiov, iov, iovcnt * sizeof *iov);
+	for(i = 0; i < iovcnt; ++i)
+	{
+		if(!check_buffer_pages(kiov[i].iov_base, kiov[i].iov_len))
+			sysexit(-1);
+#ifdef VM
+		if(!write && !page_writable(kiov[i].iov_base, kiov[i].iov_len))
+			sysexit(-1);
+#endif
+	}
+
+	if(write && fd == (int) CONSOLEWRITE)
+	{
+		for(i = 0; i < iovcnt; ++i)
+		{
+			putbuf(kiov[i].iov_base, kiov[i].iov_len);
+			total += kiov[i].iov_len;
+		}
+		user_return(total);
+	}
+	if(!write && fd == (int) CONSOLEREAD)
+	{
+		for(i = 0; i < iovcnt; ++i)
+		{
+			char *char_buffer = kiov[i].iov_base;
+			size_t n;
+			for(n = 0; n < kiov[i].iov_len; ++n)
+				*char_buffer++ = input_getc();
+			total += kiov[i].iov_len;
+		}
+		user_return(total);
+	}
+
+	struct file *file = fd_get_file(fd);
+	if (file == NULL || inode_is_dir(file_get_inode(file)))
+	{
+		user_return(-1);
+	}
+
+	for(i = 0; i < iovcnt; ++i)
+	{
+		int bytes = file_io(file, kiov[i].iov_base, kiov[i].iov_len, -1, write);
+		total += bytes;
+		if(bytes < (int) kiov[i].iov_len)
+			break;
+	}
+	user_return(total);
+}
+
+/* Copies up to LENGTH bytes from IN_FD to OUT_FD, at and advancing
+   each one's position, entirely within the kernel.  Fails if the
+   two are the same open file, or name ranges of one file that
+   overlap. */
+static void
+syscopy(struct intr_frame *frame, int in_fd, int out_fd, unsigned length)
+{
+	struct file *in = fd_get_file(in_fd);
+	struct file *out = fd_get_file(out_fd);
+
+	if (in == NULL || out == NULL || in == out
+		|| inode_is_dir(file_get_inode(in)) || inode_is_dir(file_get_inode(out))
+		|| (off_t) length < 0)
+	{
+		user_return(-1);
+	}
+	else
+	{
+		user_return( file_copy(out, in, length) );
+	}
+}
+
+/* Reads SIZE bytes from FILE into user BUFFER, or if WRITE writes
+   them from BUFFER to FILE, at byte POSITION, or at the file's
+   own position if POSITION is negative.  Returns the number of
+   bytes transferred. */
+static int
+file_io(struct file *file, void *buffer, unsigned size, off_t position, bool write)
+{
+	int bytes;
+
+#ifdef VM
+	/* Keep the buffer resident while the file system holds its locks.
+	   A read writes into it, so it must not be read-only. */
+	if(!page_pin(buffer, size, !write))
+		sysexit(-1);
+#endif
+	if(position < 0)
+		bytes = write ? file_write(file, buffer, size) : file_read(file, buffer, size);
+	else if(write)
+		bytes = file_write_at(file, buffer, size, position);
+	else
+		bytes = file_read_at(file, buffer, size, position);
+#ifdef VM
+	page_unpin(buffer, size);
+#endif
+	return bytes;
+}
+
+static void
+syschdir(struct intr_frame *frame, const char *dir)
+{
+	user_return( filesys_chdir(dir) );
+}
+
+static void
+sysmkdir(struct intr_frame *frame, const char *dir)
+{
+	user_return( filesys_mkdir(dir) );
+}
+
+/* Reads the next entry of the directory open as FD into NAME.  The
+   directory's position is kept as the file's position. */
+static void
+sysreaddir(struct intr_frame *frame, int fd, char *name)
+{
+	struct file *file = fd_get_file(fd);
+
+	if (file == NULL || !inode_is_dir(file_get_inode(file)))
+	{
+		user_return(false);
 	}
+
+	struct dir *dir = dir_open(inode_reopen(file_get_inode(file)));
+	if (dir == NULL)
+	{
+		user_return(false);
+	}
+
+	dir_seek(dir, file_tell(file));
+	bool result = dir_readdir(dir, name);
+	file_seek(file, dir_tell(dir));
+	dir_close(dir);
+	user_return(result);
+}
+
+static void
+sysisdir(struct intr_frame *frame, int fd)
+{
+	struct file *file = fd_get_file(fd);
+
+	if (file == NULL)
+	{
+		user_return(false);
+	}
+	else
+	{
+		user_return( inode_is_dir(file_get_inode(file)) );
+	}
+}
+
+static void
+sysinumber(struct intr_frame *frame, int fd)
+{
+	struct file *file = fd_get_file(fd);
+
+	if (file == NULL)
+	{
+		user_return(-1);
+	}
+	else
+	{
+		user_return( inode_get_inumber(file_get_inode(file)) );
+	}
+}
+
+#ifdef VM
+static void
+sysmmap(struct intr_frame *frame, int fd, void *addr)
+{
+	struct file *file = fd_get_file(fd);
+
+	if (file == NULL)
+	{
+		user_return(MAP_FAILED);
+	}
+	else
+	{
+		user_return( mmap_map(file, addr) );
+	}
+}
+
+static void
+sysmunmap(mapid_t mapid)
+{
+	if(!mmap_unmap(mapid))
+		sysexit(-1);
 }
+#endif
 
 bool exit_remove(tid_t id)
 {
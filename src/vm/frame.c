@@ -0,0 +1,172 @@
+#include "vm/frame.h"
+#include <debug.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "vm/page.h"
+
+/* Frame table.
+
+   Every page obtained from the user pool for a user process is
+   recorded here, along with the supplemental page table entry
+   that occupies it.  When the user pool runs dry, a frame is
+   reclaimed from some process by the clock algorithm.
+
+   A frame's lock is held by whoever is loading, evicting, or
+   freeing its page, and by system calls that need the page to
+   stay resident.  The evictor only considers frames whose lock
+   it can get without waiting. */
+static struct list frame_list;
+static struct lock frame_table_lock;    /* Protects frame_list, clock_hand. */
+static struct list_elem *clock_hand;    /* Next eviction candidate. */
+
+/* Initializes the frame table. */
+void
+frame_init (void)
+{
+  list_init (&frame_list);
+  lock_init (&frame_table_lock);
+  clock_hand = list_end (&frame_list);
+}
+
+/* Advances the clock hand, wrapping around at the end of the
+   frame table, and returns the frame it pointed to.  The frame
+   table must not be empty.  Caller must hold frame_table_lock. */
+static struct frame *
+clock_advance (void)
+{
+  struct list_elem *e;
+
+  if (clock_hand == list_end (&frame_list))
+    clock_hand = list_begin (&frame_list);
+  e = clock_hand;
+  clock_hand = list_next (clock_hand);
+  return list_entry (e, struct frame, elem);
+}
+
+/* Chooses a frame whose page has not been accessed recently,
+   writes that page out, and returns the frame, locked.  Returns
+   a null pointer if no page can be evicted. */
+static struct frame *
+evict (void)
+{
+  size_t tries, limit;
+
+  lock_acquire (&frame_table_lock);
+  /* Two sweeps clear every accessed bit; a third allows for
+     pages that could not be written out. */
+  limit = 3 * list_size (&frame_list);
+  for (tries = 0; tries < limit; tries++)
+    {
+      struct frame *f = clock_advance ();
+
+      if (!lock_try_acquire (&f->lock))
+        continue;
+      if (page_accessed_recently (f->page))
+        {
+          lock_release (&f->lock);
+          continue;
+        }
+
+      /* Writing the page out may take a while, and needs no
+         access to the frame table. */
+      lock_release (&frame_table_lock);
+      if (page_out (f->page))
+        {
+          f->page = NULL;
+          return f;
+        }
+      lock_release (&f->lock);
+      lock_acquire (&frame_table_lock);
+    }
+  lock_release (&frame_table_lock);
+
+  return NULL;
+}
+
+/* Obtains a frame for PAGE, zeroed if ZERO is true, evicting
+   some other page if the user pool is exhausted.  Returns the
+   frame, locked, or a null pointer if no frame is available. */
+struct frame *
+frame_alloc (struct page *page, bool zero)
+{
+  struct frame *f;
+  void *kpage;
+
+  kpage = palloc_get_page (PAL_USER | (zero ? PAL_ZERO : 0));
+  if (kpage == NULL)
+    {
+      f = evict ();
+      if (f == NULL)
+        return NULL;
+      if (zero)
+        memset (f->kpage, 0, PGSIZE);
+      f->page = page;
+      return f;
+    }
+
+  f = malloc (sizeof *f);
+  if (f == NULL)
+    {
+      palloc_free_page (kpage);
+      return NULL;
+    }
+  lock_init (&f->lock);
+  lock_acquire (&f->lock);
+  f->kpage = kpage;
+  f->page = page;
+
+  lock_acquire (&frame_table_lock);
+  list_push_back (&frame_list, &f->elem);
+  lock_release (&frame_table_lock);
+  return f;
+}
+
+/* Returns locked frame F to the user pool.  F's page must no
+   longer be mapped in any page directory. */
+void
+frame_free (struct frame *f)
+{
+  ASSERT (lock_held_by_current_thread (&f->lock));
+
+  lock_acquire (&frame_table_lock);
+  if (clock_hand == &f->elem)
+    clock_hand = list_next (clock_hand);
+  list_remove (&f->elem);
+  lock_release (&frame_table_lock);
+
+  lock_release (&f->lock);
+  palloc_free_page (f->kpage);
+  free (f);
+}
+
+/* Locks the frame holding PAGE, if PAGE is resident, so that it
+   stays resident until frame_unlock().  Returns true if PAGE is
+   resident, false otherwise.  PAGE must belong to the running
+   thread. */
+bool
+frame_lock (struct page *page)
+{
+  for (;;)
+    {
+      struct frame *f = page->frame;
+
+      if (f == NULL)
+        return false;
+      lock_acquire (&f->lock);
+      if (f == page->frame)
+        return true;
+
+      /* Evicted while we waited. */
+      lock_release (&f->lock);
+    }
+}
+
+/* Unlocks frame F, locked by frame_alloc() or frame_lock(). */
+void
+frame_unlock (struct frame *f)
+{
+  ASSERT (lock_held_by_current_thread (&f->lock));
+  lock_release (&f->lock);
+}
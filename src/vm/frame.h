@@ -0,0 +1,26 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <list.h>
+#include <stdbool.h>
+#include "threads/synch.h"
+
+struct page;
+
+/* A physical frame holding a user page. */
+struct frame
+  {
+    struct lock lock;           /* Held while the frame's page is in use. */
+    void *kpage;                /* Kernel virtual address of the frame. */
+    struct page *page;          /* Page occupying the frame. */
+    struct list_elem elem;      /* Element in the frame table. */
+  };
+
+void frame_init (void);
+struct frame *frame_alloc (struct page *, bool zero);
+void frame_free (struct frame *);
+
+bool frame_lock (struct page *);
+void frame_unlock (struct frame *);
+
+#endif /* vm/frame.h */
@@ -0,0 +1,125 @@
+#include "vm/mmap.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/page.h"
+
+/* Memory-mapped files.
+
+   Each mapping adds one PAGE_MMAP page per page of the file to
+   the supplemental page table.  Nothing is read until the process
+   touches a page, and only pages the process modified are written
+   back, on eviction or when the mapping goes away. */
+
+/* A memory mapping. */
+struct mapping
+  {
+    mapid_t id;                 /* Mapping identifier. */
+    struct file *file;          /* Mapped file, private to the mapping. */
+    uint8_t *addr;              /* Start of the mapping. */
+    size_t page_cnt;            /* Number of pages mapped. */
+    struct list_elem elem;      /* Element in thread's mappings list. */
+  };
+
+static void unmap (struct mapping *);
+
+/* Maps FILE into the running thread's address space starting at
+   ADDR, which must be page-aligned.  The mapping uses its own
+   handle to FILE, so closing FILE does not affect it.  Returns the
+   new mapping's identifier, or MAP_FAILED if FILE is empty, ADDR is
+   unsuitable, any page in the range is already in use, or memory
+   is exhausted. */
+mapid_t
+mmap_map (struct file *file, void *addr)
+{
+  struct thread *t = thread_current ();
+  struct mapping *m;
+  off_t length;
+  size_t page_cnt;
+  size_t i;
+
+  length = file_length (file);
+  page_cnt = DIV_ROUND_UP (length, PGSIZE);
+  if (addr == NULL || pg_ofs (addr) != 0 || length == 0
+      || !is_user_vaddr ((uint8_t *) addr + length - 1))
+    return MAP_FAILED;
+
+  m = malloc (sizeof *m);
+  if (m == NULL)
+    return MAP_FAILED;
+  m->file = file_reopen (file);
+  if (m->file == NULL)
+    {
+      free (m);
+      return MAP_FAILED;
+    }
+  m->id = t->next_mapid++;
+  m->addr = addr;
+  m->page_cnt = 0;
+  list_push_back (&t->mappings, &m->elem);
+
+  for (i = 0; i < page_cnt; i++)
+    {
+      off_t ofs = i * PGSIZE;
+      size_t read_bytes = length - ofs < PGSIZE ? length - ofs : PGSIZE;
+
+      if (!page_add_mmap (m->addr + ofs, m->file, ofs, read_bytes))
+        {
+          unmap (m);
+          return MAP_FAILED;
+        }
+      m->page_cnt++;
+    }
+  return m->id;
+}
+
+/* Removes the running thread's mapping with identifier MAPID,
+   writing back modified pages.  Returns true if successful, false
+   if there is no such mapping. */
+bool
+mmap_unmap (mapid_t mapid)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&t->mappings); e != list_end (&t->mappings);
+       e = list_next (e))
+    {
+      struct mapping *m = list_entry (e, struct mapping, elem);
+      if (m->id == mapid)
+        {
+          unmap (m);
+          return true;
+        }
+    }
+  return false;
+}
+
+/* Removes all of the running thread's mappings, writing back
+   modified pages.  Must be called before the supplemental page
+   table is destroyed. */
+void
+mmap_unmap_all (void)
+{
+  struct thread *t = thread_current ();
+
+  while (!list_empty (&t->mappings))
+    unmap (list_entry (list_front (&t->mappings), struct mapping, elem));
+}
+
+/* Removes mapping M and its pages, and frees M. */
+static void
+unmap (struct mapping *m)
+{
+  size_t i;
+
+  for (i = 0; i < m->page_cnt; i++)
+    page_remove (m->addr + i * PGSIZE);
+  list_remove (&m->elem);
+  file_close (m->file);
+  free (m);
+}
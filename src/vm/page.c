@@ -0,0 +1,402 @@
+#include "vm/page.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "vm/frame.h"
+#include "vm/swap.h"
+
+/* Supplemental page table.
+
+   Each process records in its page table every page of its user
+   address space, resident or not, along with where to find its
+   contents.  Pages are brought into frames on demand by
+   page_in(), normally from the page fault handler, and written
+   out by page_out() when the frame table needs their frames.
+   Pages that are clean and can be read back from a file or
+   recreated as zeros are simply dropped, dirty pages of
+   memory-mapped files are written back to the file, and
+   everything else goes to swap. */
+
+static hash_hash_func page_hash;
+static hash_less_func page_less;
+static hash_action_func page_destroy;
+
+/* Initializes the running thread's supplemental page table.
+   Returns true if successful, false if memory is exhausted. */
+bool
+page_table_init (void)
+{
+  return hash_init (&thread_current ()->pages, page_hash, page_less, NULL);
+}
+
+/* Destroys the running thread's supplemental page table,
+   releasing every frame it holds.  Must be called before the
+   thread's page directory is destroyed. */
+void
+page_table_destroy (void)
+{
+  hash_destroy (&thread_current ()->pages, page_destroy);
+}
+
+/* Adds a page of the given TYPE at UPAGE to the running
+   thread's page table and returns it.  Returns a null pointer if
+   UPAGE is already in use or memory is exhausted. */
+static struct page *
+page_add (void *upage, bool writable, enum page_type type)
+{
+  struct page *p;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+
+  p = malloc (sizeof *p);
+  if (p == NULL)
+    return NULL;
+
+  p->upage = upage;
+  p->owner = thread_current ();
+  p->writable = writable;
+  p->type = type;
+  p->frame = NULL;
+  p->file = NULL;
+  p->file_ofs = 0;
+  p->read_bytes = 0;
+  p->swap_slot = SWAP_ERROR;
+  if (hash_insert (&thread_current ()->pages, &p->hash_elem) != NULL)
+    {
+      free (p);
+      return NULL;
+    }
+  return p;
+}
+
+/* Adds a page at UPAGE that starts out as all zeros.  Returns
+   true if successful, false if UPAGE is already in use or memory
+   is exhausted. */
+bool
+page_add_zero (void *upage, bool writable)
+{
+  return page_add (upage, writable, PAGE_ZERO) != NULL;
+}
+
+/* Adds a page at UPAGE whose first READ_BYTES bytes are read
+   from FILE starting at offset OFS, with the rest zeroed.  FILE
+   must stay open as long as the page exists.  Returns true if
+   successful, false if UPAGE is already in use or memory is
+   exhausted. */
+bool
+page_add_file (void *upage, struct file *file, off_t ofs,
+               size_t read_bytes, bool writable)
+{
+  struct page *p;
+
+  ASSERT (read_bytes <= PGSIZE);
+
+  p = page_add (upage, writable, PAGE_FILE);
+  if (p == NULL)
+    return false;
+  p->file = file;
+  p->file_ofs = ofs;
+  p->read_bytes = read_bytes;
+  return true;
+}
+
+/* Adds a writable page at UPAGE backed by READ_BYTES bytes of
+   FILE starting at offset OFS, as part of a memory mapping.  The
+   rest of the page reads as zeros and is never written back.
+   Returns true if successful, false if UPAGE is already in use
+   or memory is exhausted. */
+bool
+page_add_mmap (void *upage, struct file *file, off_t ofs,
+               size_t read_bytes)
+{
+  struct page *p;
+
+  ASSERT (read_bytes <= PGSIZE);
+
+  p = page_add (upage, true, PAGE_MMAP);
+  if (p == NULL)
+    return false;
+  p->file = file;
+  p->file_ofs = ofs;
+  p->read_bytes = read_bytes;
+  return true;
+}
+
+/* Removes the running thread's page at UPAGE, which must exist,
+   writing it back first if it is a modified page of a
+   memory-mapped file. */
+void
+page_remove (void *upage)
+{
+  struct page *p = page_lookup (upage);
+
+  ASSERT (p != NULL);
+  hash_delete (&thread_current ()->pages, &p->hash_elem);
+  page_destroy (&p->hash_elem, NULL);
+}
+
+/* Writes resident PAGE_MMAP page P back to its file if it has
+   been modified.  P must already be unmapped, so that it cannot
+   be modified again behind our back. */
+static void
+write_back (struct page *p)
+{
+  ASSERT (p->type == PAGE_MMAP);
+
+  if (pagedir_is_dirty (p->owner->pagedir, p->upage))
+    file_write_at (p->file, p->frame->kpage, p->read_bytes, p->file_ofs);
+}
+
+/* Returns the running thread's page that contains UADDR, or a
+   null pointer if there is none. */
+struct page *
+page_lookup (const void *uaddr)
+{
+  struct page p;
+  struct hash_elem *e;
+
+  p.upage = pg_round_down (uaddr);
+  e = hash_find (&thread_current ()->pages, &p.hash_elem);
+  return e != NULL ? hash_entry (e, struct page, hash_elem) : NULL;
+}
+
+/* Makes the running thread's page containing UADDR resident and
+   mapped, and returns it with its frame locked.  Returns a null
+   pointer if UADDR is not part of the address space or its
+   contents could not be loaded. */
+static struct page *
+page_in_and_lock (const void *uaddr)
+{
+  struct page *p;
+  struct frame *f;
+
+  if (!is_user_vaddr (uaddr))
+    return NULL;
+  p = page_lookup (uaddr);
+  if (p == NULL)
+    return NULL;
+  if (frame_lock (p))
+    return p;
+
+  f = frame_alloc (p, p->type == PAGE_ZERO);
+  if (f == NULL)
+    return NULL;
+
+  if (p->type == PAGE_FILE || p->type == PAGE_MMAP)
+    {
+      if (file_read_at (p->file, f->kpage, p->read_bytes, p->file_ofs)
+          != (off_t) p->read_bytes)
+        {
+          frame_free (f);
+          return NULL;
+        }
+      memset ((uint8_t *) f->kpage + p->read_bytes, 0,
+              PGSIZE - p->read_bytes);
+    }
+  else if (p->type == PAGE_SWAP)
+    {
+      swap_in (p->swap_slot, f->kpage);
+      swap_free (p->swap_slot);
+      p->swap_slot = SWAP_ERROR;
+    }
+
+  if (!pagedir_set_page (p->owner->pagedir, p->upage, f->kpage,
+                         p->writable))
+    {
+      frame_free (f);
+      return NULL;
+    }
+  p->frame = f;
+  return p;
+}
+
+/* Makes the running thread's page containing UADDR resident and
+   maps it.  Returns true if successful, false if UADDR is not
+   part of the address space or its contents could not be
+   loaded. */
+bool
+page_in (const void *uaddr)
+{
+  struct page *p = page_in_and_lock (uaddr);
+
+  if (p == NULL)
+    return false;
+  frame_unlock (p->frame);
+  return true;
+}
+
+/* Extends the running thread's stack to cover UADDR, given the
+   user stack pointer ESP, and brings in the new page.  An access
+   counts as a stack access if it is within the STACK_MAX bytes
+   below PHYS_BASE and no more than 32 bytes below ESP, which is
+   how far PUSHA reaches before it moves the stack pointer.
+   Returns true if successful, false if UADDR is not a stack
+   access or memory is exhausted. */
+bool
+page_grow_stack (const void *uaddr, const void *esp)
+{
+  void *upage = pg_round_down (uaddr);
+
+  if ((const uint8_t *) uaddr < (const uint8_t *) PHYS_BASE - STACK_MAX
+      || (const uint8_t *) uaddr < (const uint8_t *) esp - 32
+      || !is_user_vaddr (uaddr))
+    return false;
+  return page_add_zero (upage, true) && page_in (upage);
+}
+
+/* Writes out page P, whose frame the caller has locked, and
+   unmaps it so that the frame can be reused.  Returns true if
+   successful, false if P must go to swap and swap is full. */
+bool
+page_out (struct page *p)
+{
+  struct frame *f = p->frame;
+  uint32_t *pd = p->owner->pagedir;
+  bool dirty;
+
+  ASSERT (f != NULL);
+  ASSERT (lock_held_by_current_thread (&f->lock));
+
+  /* Unmap first, so that the owner faults instead of modifying
+     the page while we look at it. */
+  pagedir_clear_page (pd, p->upage);
+  dirty = pagedir_is_dirty (pd, p->upage);
+
+  if (p->type == PAGE_MMAP)
+    write_back (p);
+  else if (dirty || p->type == PAGE_SWAP)
+    {
+      size_t slot = swap_out (f->kpage);
+      if (slot == SWAP_ERROR)
+        {
+          pagedir_set_page (pd, p->upage, f->kpage, p->writable);
+          pagedir_set_dirty (pd, p->upage, dirty);
+          return false;
+        }
+      p->type = PAGE_SWAP;
+      p->swap_slot = slot;
+    }
+  p->frame = NULL;
+  return true;
+}
+
+/* Returns true if page P, whose frame the caller has locked, has
+   been accessed since the last call, false otherwise. */
+bool
+page_accessed_recently (struct page *p)
+{
+  uint32_t *pd = p->owner->pagedir;
+
+  ASSERT (p->frame != NULL);
+  ASSERT (lock_held_by_current_thread (&p->frame->lock));
+
+  if (!pagedir_is_accessed (pd, p->upage))
+    return false;
+  pagedir_set_accessed (pd, p->upage, false);
+  return true;
+}
+
+/* Returns true if the running thread's pages spanning SIZE bytes
+   starting at UADDR are all in its address space and writable,
+   false otherwise. */
+bool
+page_writable (const void *uaddr, size_t size)
+{
+  const uint8_t *upage;
+
+  if (size == 0)
+    return true;
+  for (upage = pg_round_down (uaddr);
+       upage < (const uint8_t *) uaddr + size; upage += PGSIZE)
+    {
+      struct page *p = is_user_vaddr (upage) ? page_lookup (upage) : NULL;
+      if (p == NULL || !p->writable)
+        return false;
+    }
+  return true;
+}
+
+/* Makes the running thread's pages spanning SIZE bytes starting
+   at UADDR resident and keeps them so until page_unpin().  This
+   lets the kernel access a user buffer without faulting while it
+   holds file system locks.  If WRITE is true, the kernel will
+   write to the buffer, so every page must be writable.  Returns
+   true if successful, false if part of the buffer is not in the
+   address space or, for WRITE, is read-only. */
+bool
+page_pin (const void *uaddr, size_t size, bool write)
+{
+  const uint8_t *start = pg_round_down (uaddr);
+  const uint8_t *upage;
+
+  if (size == 0)
+    return true;
+  if (write && !page_writable (uaddr, size))
+    return false;
+  for (upage = start; upage < (const uint8_t *) uaddr + size;
+       upage += PGSIZE)
+    if (page_in_and_lock (upage) == NULL)
+      {
+        if (upage > start)
+          page_unpin (start, upage - start);
+        return false;
+      }
+  return true;
+}
+
+/* Releases the pages pinned by page_pin(UADDR, SIZE). */
+void
+page_unpin (const void *uaddr, size_t size)
+{
+  const uint8_t *upage;
+
+  if (size == 0)
+    return;
+  for (upage = pg_round_down (uaddr);
+       upage < (const uint8_t *) uaddr + size; upage += PGSIZE)
+    frame_unlock (page_lookup (upage)->frame);
+}
+
+/* Returns a hash value for page P. */
+static unsigned
+page_hash (const struct hash_elem *p_, void *aux UNUSED)
+{
+  const struct page *p = hash_entry (p_, struct page, hash_elem);
+  return hash_bytes (&p->upage, sizeof p->upage);
+}
+
+/* Returns true if page A precedes page B. */
+static bool
+page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct page *a = hash_entry (a_, struct page, hash_elem);
+  const struct page *b = hash_entry (b_, struct page, hash_elem);
+  return a->upage < b->upage;
+}
+
+/* Unmaps page P, writing it back if it is a modified page of a
+   memory-mapped file, frees its frame or swap slot, and frees
+   P. */
+static void
+page_destroy (struct hash_elem *p_, void *aux UNUSED)
+{
+  struct page *p = hash_entry (p_, struct page, hash_elem);
+
+  /* Locking the frame waits out any eviction in progress. */
+  if (frame_lock (p))
+    {
+      pagedir_clear_page (p->owner->pagedir, p->upage);
+      if (p->type == PAGE_MMAP)
+        write_back (p);
+      frame_free (p->frame);
+    }
+  else if (p->type == PAGE_SWAP)
+    swap_free (p->swap_slot);
+  free (p);
+}
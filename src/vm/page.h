@@ -0,0 +1,65 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <hash.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/off_t.h"
+
+struct file;
+struct frame;
+struct thread;
+
+/* Maximum size of a process's stack, in bytes. */
+#define STACK_MAX (8 * 1024 * 1024)
+
+/* Where a page's contents are when it is not resident. */
+enum page_type
+  {
+    PAGE_ZERO,                  /* All zeros. */
+    PAGE_FILE,                  /* Read from a file, then zeros. */
+    PAGE_SWAP,                  /* In a swap slot. */
+    PAGE_MMAP                   /* In a memory-mapped file. */
+  };
+
+/* Supplemental page table entry: one page of a process's user
+   virtual address space. */
+struct page
+  {
+    void *upage;                /* User virtual address. */
+    struct thread *owner;       /* Process that owns the page. */
+    bool writable;              /* May the process write it? */
+    enum page_type type;        /* Where the contents are. */
+    struct frame *frame;        /* Frame, or null if not resident. */
+
+    /* PAGE_SWAP only. */
+    size_t swap_slot;           /* Swap slot, if not resident. */
+
+    /* PAGE_FILE and PAGE_MMAP only. */
+    struct file *file;          /* File to read from. */
+    off_t file_ofs;             /* Offset in FILE. */
+    size_t read_bytes;          /* Bytes to read; the rest are zeroed. */
+
+    struct hash_elem hash_elem; /* Element in the thread's page table. */
+  };
+
+bool page_table_init (void);
+void page_table_destroy (void);
+
+bool page_add_zero (void *upage, bool writable);
+bool page_add_file (void *upage, struct file *, off_t ofs,
+                    size_t read_bytes, bool writable);
+bool page_add_mmap (void *upage, struct file *, off_t ofs,
+                    size_t read_bytes);
+void page_remove (void *upage);
+struct page *page_lookup (const void *uaddr);
+bool page_in (const void *uaddr);
+bool page_grow_stack (const void *uaddr, const void *esp);
+bool page_out (struct page *);
+bool page_accessed_recently (struct page *);
+
+bool page_writable (const void *uaddr, size_t size);
+bool page_pin (const void *uaddr, size_t size, bool write);
+void page_unpin (const void *uaddr, size_t size);
+
+#endif /* vm/page.h */
@@ -0,0 +1,97 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "devices/block.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Swap manager.
+
+   The swap device is divided into page-sized slots of
+   SECTORS_PER_SLOT contiguous sectors each, tracked by a bitmap.
+   Slots are handed out next-fit, so that pages evicted one after
+   another land next to each other on disk. */
+
+/* Number of sectors in a swap slot. */
+#define SECTORS_PER_SLOT (PGSIZE / BLOCK_SECTOR_SIZE)
+
+static struct block *swap_device;
+static struct bitmap *swap_map;         /* In-use slots. */
+static size_t swap_hint;                /* Where to start the next search. */
+static struct lock swap_lock;           /* Protects swap_map, swap_hint. */
+
+/* Sets up swap on the BLOCK_SWAP device, if there is one.
+   Without one, swap_out() always fails. */
+void
+swap_init (void)
+{
+  size_t slot_cnt = 0;
+
+  lock_init (&swap_lock);
+  swap_device = block_get_role (BLOCK_SWAP);
+  if (swap_device != NULL)
+    slot_cnt = block_size (swap_device) / SECTORS_PER_SLOT;
+  else
+    printf ("swap: no swap device, running without swap\n");
+
+  swap_map = bitmap_create (slot_cnt);
+  if (swap_map == NULL)
+    PANIC ("swap: bitmap creation failed");
+  swap_hint = 0;
+}
+
+/* Claims a free slot, searching from the slot after the last
+   one claimed.  Returns SWAP_ERROR if swap is full. */
+static size_t
+slot_alloc (void)
+{
+  size_t slot;
+
+  lock_acquire (&swap_lock);
+  slot = bitmap_scan_and_flip (swap_map, swap_hint, 1, false);
+  if (slot == BITMAP_ERROR && swap_hint > 0)
+    slot = bitmap_scan_and_flip (swap_map, 0, 1, false);
+  if (slot != BITMAP_ERROR)
+    swap_hint = slot + 1 < bitmap_size (swap_map) ? slot + 1 : 0;
+  lock_release (&swap_lock);
+
+  return slot != BITMAP_ERROR ? slot : SWAP_ERROR;
+}
+
+/* Writes the page at KPAGE to a free swap slot and returns the
+   slot, or SWAP_ERROR if swap is full. */
+size_t
+swap_out (const void *kpage)
+{
+  size_t slot = slot_alloc ();
+
+  if (slot == SWAP_ERROR)
+    return SWAP_ERROR;
+
+  block_write_multiple (swap_device, slot * SECTORS_PER_SLOT,
+                        SECTORS_PER_SLOT, kpage);
+  return slot;
+}
+
+/* Reads swap slot SLOT into the page at KPAGE.  The slot stays
+   allocated until swap_free() is called. */
+void
+swap_in (size_t slot, void *kpage)
+{
+  ASSERT (slot < bitmap_size (swap_map));
+
+  block_read_multiple (swap_device, slot * SECTORS_PER_SLOT,
+                       SECTORS_PER_SLOT, kpage);
+}
+
+/* Releases swap slot SLOT. */
+void
+swap_free (size_t slot)
+{
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_test (swap_map, slot));
+  bitmap_reset (swap_map, slot);
+  lock_release (&swap_lock);
+}